@@ -0,0 +1,115 @@
+#include "pch.h"
+#include "AtomTable.h"
+
+#include <thread>
+
+AtomTable::Shard::~Shard()
+{
+    for (auto block : textBlocks) delete[] block;
+}
+
+string_view AtomTable::Shard::copyText(string_view text)
+{
+    // Long text gets a block of its own, and the current block keeps going.
+    if (textBlockSize / 4 < text.size())
+    {
+        char* block = new char[text.size()];
+        textBlocks.insert(textBlocks.end() - (textBlocks.empty() ? 0 : 1), block);
+
+        memcpy(block, text.data(), text.size());
+        return string_view(block, text.size());
+    }
+
+    if (textBlockSize - textUsed < text.size())
+    {
+        textBlocks.push_back(new char[textBlockSize]);
+        textUsed = 0;
+    }
+
+    char* copy = textBlocks.back() + textUsed;
+    textUsed += text.size();
+
+    memcpy(copy, text.data(), text.size());
+    return string_view(copy, text.size());
+}
+
+AtomTable::AtomTable() :
+    nextAtom(1),
+    publishedAtoms(noAtom)
+{
+    for (auto& block : atomBlocks) block = NULL;
+}
+
+AtomTable::~AtomTable()
+{
+    for (auto& block : atomBlocks) delete[] block.load();
+}
+
+void AtomTable::setAtomText(uint32_t atom, string_view text)
+{
+    size_t blockIndex = atom >> atomBlockBits;
+    if (atomBlockCount <= blockIndex) throw length_error("AtomTable is full");
+
+    string_view* block = atomBlocks[blockIndex].load(memory_order_acquire);
+    if (NULL == block)
+    {
+        lock_guard<mutex> blocksLock(atomBlocksLock);
+
+        block = atomBlocks[blockIndex].load(memory_order_relaxed);
+        if (NULL == block)
+        {
+            block = new string_view[atomBlockSize];
+            atomBlocks[blockIndex].store(block, memory_order_release);
+        }
+    }
+
+    block[atom & (atomBlockSize - 1)] = text;
+}
+
+void AtomTable::publish(uint32_t atom)
+{
+    // The atoms are numbered under different shard locks, so an earlier one can still be storing its text.
+    // That never waits on a shard lock, so this is a short wait.
+    uint32_t previous = atom - 1;
+    while (!publishedAtoms.compare_exchange_weak(previous, atom, memory_order_release, memory_order_relaxed))
+    {
+        previous = atom - 1;
+        this_thread::yield();
+    }
+}
+
+uint32_t AtomTable::intern(string_view text)
+{
+    Shard& shard = shards[hash<string_view>()(text) % shardCount];
+
+    lock_guard<mutex> shardLock(shard.lock);
+
+    auto found = shard.atoms.find(text);
+    if (found != shard.atoms.end()) return found->second;
+
+    string_view copy = shard.copyText(text);
+    uint32_t atom = nextAtom++;
+
+    setAtomText(atom, copy);
+    publish(atom);
+    shard.atoms.emplace(copy, atom);
+
+    return atom;
+}
+
+uint32_t AtomTable::find(string_view text)
+{
+    Shard& shard = shards[hash<string_view>()(text) % shardCount];
+
+    lock_guard<mutex> shardLock(shard.lock);
+
+    auto found = shard.atoms.find(text);
+    return (found != shard.atoms.end()) ? found->second : noAtom;
+}
+
+string_view AtomTable::text(uint32_t atom) const
+{
+    if (noAtom == atom || publishedAtoms.load(memory_order_acquire) < atom) return string_view();
+
+    return atomBlocks[atom >> atomBlockBits].load(memory_order_acquire)[atom & (atomBlockSize - 1)];
+}
@@ -0,0 +1,81 @@
+#ifndef ATOM_TABLE_H_INCLUDED
+#define ATOM_TABLE_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+/*
+* A string pool that gives each distinct string a dense 32 bit id - an atom.
+*
+* The Tokenizer stamps identifier tokens with their atom (Token::atom) when Tokenizer::atoms is set, so the
+* symbol table and the parser compare and hash integers instead of strings.
+*
+* intern can be called from any number of threads.  The strings are split over shards by hash, each with its
+* own lock, and the text is copied into the table so it outlives the source buffers.
+* text and size never lock.  An atom is only published, for them, after its text is stored - and the atoms are
+* published in order, so every atom from 1 to size() has its text.
+* Atoms start at 1 - noAtom (0) is a token that was not interned.
+*/
+class EXPORT AtomTable
+{
+public:
+    static constexpr uint32_t noAtom = 0;
+
+protected:
+    static const size_t shardCount = 64;
+    static const size_t textBlockSize = 64 * 1024;
+    static const size_t atomBlockBits = 14;
+    static const size_t atomBlockSize = size_t(1) << atomBlockBits;
+    static const size_t atomBlockCount = 4096;     // 64M atoms
+
+    struct Shard
+    {
+        std::mutex                                      lock;
+        std::unordered_map<std::string_view, uint32_t>  atoms;
+
+        // The interned text, in blocks that never move
+        std::vector<char*>                              textBlocks;
+        size_t                                          textUsed;
+
+        Shard() : textUsed(textBlockSize) {}
+        ~Shard();
+
+        std::string_view copyText(std::string_view text);
+    };
+
+    Shard                               shards[shardCount];
+
+    // The text for each atom, in blocks that are added as needed.  Reading never locks.
+    std::atomic<std::string_view*>      atomBlocks[atomBlockCount];
+    std::mutex                          atomBlocksLock;
+    std::atomic<uint32_t>               nextAtom;
+    std::atomic<uint32_t>               publishedAtoms;     // The last atom text and size can see
+
+    void setAtomText(uint32_t atom, std::string_view text);
+
+    // Make atom visible to text and size, after all the atoms before it.
+    void publish(uint32_t atom);
+
+public:
+    AtomTable();
+    ~AtomTable();
+
+    AtomTable(const AtomTable&) = delete;
+    AtomTable& operator=(const AtomTable&) = delete;
+
+    // The atom for text, adding it if it is new.
+    uint32_t intern(std::string_view text);
+
+    // The atom for text, or noAtom if it has not been interned.
+    uint32_t find(std::string_view text);
+
+    // The text of an atom.  Empty for noAtom.
+    std::string_view text(uint32_t atom) const;
+
+    // The number of atoms
+    size_t size() const { return publishedAtoms.load(std::memory_order_acquire); }
+};
+
+#endif // ATOM_TABLE_H_INCLUDED
@@ -0,0 +1,159 @@
+#include "pch.h"
+#include "CompactTokens.h"
+
+CompactTokenStore::CompactTokenStore(string_view inSource, const token_vector& tokens, bool inCodePointColumns) :
+    source(inSource),
+    codePointColumns(inCodePointColumns)
+{
+    append(tokens);
+}
+
+// The offset of the start of the line with offset on it - after the byte order mark on the first line.
+static uint32_t findLineStart(string_view source, uint32_t offset)
+{
+    const char* start = source.data();
+    const char* lineStart = start + offset;
+    while (start < lineStart && '\n' != *(lineStart - 1)) lineStart--;
+    if (start == lineStart) skipByteOrderMark(lineStart, start + offset);
+
+    return (uint32_t)(lineStart - start);
+}
+
+// The bytes from "from" up to "to" that are not characters of their own - like ReadFileData::extraBytesBetween.
+static uint32_t extraBytesBetween(string_view source, uint32_t from, uint32_t to)
+{
+    const unsigned char* runner = (const unsigned char*)source.data() + from;
+    const unsigned char* stopAt = (const unsigned char*)source.data() + to;
+    const unsigned char* end = (const unsigned char*)source.data() + source.size();
+
+    uint32_t extraBytes = 0;
+    while (runner < stopAt)
+    {
+        size_t length = (0 == (0x80 & *runner)) ? 1 : max<size_t>(ReadFileData::utf8SequenceLength(runner, end), 1);
+        extraBytes += (uint32_t)(length - 1);
+        runner += length;
+    }
+
+    return extraBytes;
+}
+
+void CompactTokenStore::reserve(size_t tokenCount)
+{
+    offsets.reserve(tokenCount);
+    lengths.reserve(tokenCount);
+    types.reserve(tokenCount);
+}
+
+void CompactTokenStore::clear()
+{
+    offsets.clear();
+    lengths.clear();
+    types.clear();
+    lineStarts.clear();
+    keywordIds.clear();
+}
+
+void CompactTokenStore::shrink_to_fit()
+{
+    offsets.shrink_to_fit();
+    lengths.shrink_to_fit();
+    types.shrink_to_fit();
+    lineStarts.shrink_to_fit();
+    keywordIds.shrink_to_fit();
+}
+
+void CompactTokenStore::push_back(const Token& token)
+{
+    if (UINT32_MAX < source.size()) throw length_error("CompactTokenStore sources are limited to 4G bytes");
+
+    const char* tokenStart = token.tokenString.data();
+    uint32_t tokenOffset = (uint32_t)source.size();
+    if (source.data() <= tokenStart && tokenStart <= source.data() + source.size())
+    {
+        tokenOffset = (uint32_t)(tokenStart - source.data());
+    }
+
+    offsets.push_back(tokenOffset);
+    lengths.push_back((uint32_t)token.tokenString.size());
+    types.push_back((uint16_t)((token.typeFlags & typeMask) | (token.hasScope ? hasScopeFlag : 0) | (token.hasEscape ? hasEscapeFlag : 0)));
+    if (0 != token.keywordId) keywordIds.push_back({ (uint32_t)(types.size() - 1), token.keywordId });
+
+    // The first token on a line gives the line start - the characters are counted in bytes from it.  A code point
+    // character does not give the bytes before it, so then the line start is found in the source.
+    if (lineStarts.empty() || lineStarts.back().line != (uint32_t)token.startingLine)
+    {
+        uint32_t lineStart = codePointColumns ? findLineStart(source, tokenOffset) : tokenOffset - (uint32_t)(token.startingCharacter - 1);
+        lineStarts.push_back({ (uint32_t)token.startingLine, lineStart });
+    }
+}
+
+void CompactTokenStore::append(const token_vector& tokens)
+{
+    reserve(size() + tokens.size());
+
+    for (const Token& token : tokens) push_back(token);
+}
+
+string_view CompactTokenStore::tokenString(size_t index) const
+{
+    // An empty token (endOfInput) still points at its place in the source, not at an empty string anywhere
+    return string_view(source.data() + offsets[index], lengths[index]);
+}
+
+uint16_t CompactTokenStore::keywordId(size_t index) const
+{
+    auto found = lower_bound(keywordIds.begin(), keywordIds.end(), index,
+        [](const KeywordIndex& keyword, size_t at) { return keyword.index < at; });
+
+    return (keywordIds.end() != found && index == found->index) ? found->keywordId : 0;
+}
+
+void CompactTokenStore::setHasScope(size_t index, bool scope)
+{
+    if (scope) types[index] |= hasScopeFlag;
+    else types[index] &= ~hasScopeFlag;
+}
+
+ScanPosition CompactTokenStore::position(size_t index) const
+{
+    uint32_t tokenOffset = offsets[index];
+
+    // The last line start at or before the token.
+    auto lineStart = upper_bound(lineStarts.begin(), lineStarts.end(), tokenOffset,
+        [](uint32_t offset, const LineStart& start) { return offset < start.offset; });
+    if (lineStart != lineStarts.begin()) --lineStart;
+
+    long character = (long)(tokenOffset - lineStart->offset) + 1;
+    if (codePointColumns) character -= (long)extraBytesBetween(source, lineStart->offset, tokenOffset);
+
+    return ScanPosition((long)lineStart->line, character);
+}
+
+Token CompactTokenStore::operator[](size_t index) const
+{
+    ScanPosition tokenPosition = position(index);
+
+    Token token(tokenPosition.lineNumber, tokenPosition.characterNumber, typeFlags(index));
+    token.hasScope = hasScope(index);
+    token.hasEscape = hasEscape(index);
+    token.keywordId = keywordId(index);
+    token.tokenString = tokenString(index);
+
+    return token;
+}
+
+token_vector CompactTokenStore::toTokenVector() const
+{
+    token_vector tokens;
+    tokens.reserve(size());
+
+    for (size_t i = 0; i < size(); i++) tokens.push_back((*this)[i]);
+
+    return tokens;
+}
+
+size_t CompactTokenStore::memoryUsed() const
+{
+    return offsets.capacity() * sizeof(uint32_t) + lengths.capacity() * sizeof(uint32_t) +
+        types.capacity() * sizeof(uint16_t) + lineStarts.capacity() * sizeof(LineStart) + keywordIds.capacity() * sizeof(KeywordIndex);
+}
@@ -0,0 +1,129 @@
+#ifndef COMPACT_TOKENS_H_INCLUDED
+#define COMPACT_TOKENS_H_INCLUDED
+
+#include "Tokenizer.h"
+
+#include <cstdint>
+
+/*
+* Compact token storage - the tokens from one source as separate arrays:
+*   32 bit byte offsets from the start of the source
+*   32 bit lengths
+*   16 bit typeFlags, with the top two bits for hasScope and hasEscape
+* 10 bytes per token instead of sizeof(Token), plus one entry per source line that has a token starting on it,
+* and one per keyword for its Token::keywordId.
+*
+* The tokenString, line and character are rebuilt when they are asked for.  The line and character come from
+* the start of the token's line (a binary search), so they are the same as the Token they were made from.
+* For tokens with their characters in code points (Tokenizer::codePointColumns) make the store with codePointColumns -
+* the line starts are found in the source, and the characters are counted from them.
+*
+* operator[], the iterators and toTokenVector give back Tokens, so code written for token_vector still works.
+*/
+class EXPORT CompactTokenStore
+{
+public:
+    static const uint16_t typeMask = 0x3FFF;
+    static const uint16_t hasEscapeFlag = 0x4000;
+    static const uint16_t hasScopeFlag = 0x8000;
+
+protected:
+    struct LineStart
+    {
+        uint32_t    line;
+        uint32_t    offset;
+    };
+
+    struct KeywordIndex
+    {
+        uint32_t    index;
+        uint16_t    keywordId;
+    };
+
+    string_view         source;
+    bool                codePointColumns;
+
+    vector<uint32_t>    offsets;
+    vector<uint32_t>    lengths;
+    vector<uint16_t>    types;
+
+    // The start of each line with a token on it, in source order
+    vector<LineStart>   lineStarts;
+
+    // The tokens with a keywordId, in index order - keywords are few, so they are not a column of their own
+    vector<KeywordIndex>    keywordIds;
+
+public:
+    CompactTokenStore(string_view inSource = string_view(), bool inCodePointColumns = false) : source(inSource), codePointColumns(inCodePointColumns) {}
+    CompactTokenStore(string_view inSource, const token_vector& tokens, bool inCodePointColumns = false);
+
+    // A random access iterator that gives back a Token for each entry.
+    class const_iterator
+    {
+    protected:
+        const CompactTokenStore*    store;
+        size_t                      index;
+
+    public:
+        using iterator_category = random_access_iterator_tag;
+        using value_type = Token;
+        using difference_type = ptrdiff_t;
+        using pointer = void;
+        using reference = Token;
+
+        const_iterator(const CompactTokenStore* inStore = NULL, size_t inIndex = 0) : store(inStore), index(inIndex) {}
+
+        Token operator*() const { return (*store)[index]; }
+        Token operator[](difference_type offset) const { return (*store)[index + offset]; }
+
+        const_iterator& operator++() { index++; return *this; }
+        const_iterator operator++(int) { const_iterator was = *this; index++; return was; }
+        const_iterator& operator--() { index--; return *this; }
+        const_iterator operator--(int) { const_iterator was = *this; index--; return was; }
+        const_iterator& operator+=(difference_type offset) { index += offset; return *this; }
+        const_iterator& operator-=(difference_type offset) { index -= offset; return *this; }
+        const_iterator operator+(difference_type offset) const { return const_iterator(store, index + offset); }
+        const_iterator operator-(difference_type offset) const { return const_iterator(store, index - offset); }
+        difference_type operator-(const const_iterator& other) const { return (difference_type)index - (difference_type)other.index; }
+
+        bool operator==(const const_iterator& other) const { return index == other.index; }
+        auto operator<=>(const const_iterator& other) const { return index <=> other.index; }
+    };
+
+    string_view sourceString() const { return source; }
+
+    size_t size() const { return types.size(); }
+    bool empty() const { return types.empty(); }
+
+    void reserve(size_t tokenCount);
+    void clear();
+    void shrink_to_fit();
+
+    // Tokens must be added in source order, and their tokenStrings must point into the source.
+    // A token with a tokenString outside of the source (endOfInput) is at the end of the source.
+    void push_back(const Token& token);
+    void append(const token_vector& tokens);
+
+    uint32_t offset(size_t index) const { return offsets[index]; }
+    uint32_t length(size_t index) const { return lengths[index]; }
+    string_view tokenString(size_t index) const;
+    long typeFlags(size_t index) const { return types[index] & typeMask; }
+    bool hasScope(size_t index) const { return 0 != (types[index] & hasScopeFlag); }
+    bool hasEscape(size_t index) const { return 0 != (types[index] & hasEscapeFlag); }
+    uint16_t keywordId(size_t index) const;
+    void setHasScope(size_t index, bool scope);
+
+    // The startingLine and startingCharacter of the token
+    ScanPosition position(size_t index) const;
+
+    // The adapters for token_vector code
+    Token operator[](size_t index) const;
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+    token_vector toTokenVector() const;
+
+    // Bytes used by the arrays
+    size_t memoryUsed() const;
+};
+
+#endif // COMPACT_TOKENS_H_INCLUDED
@@ -0,0 +1,415 @@
+#include "pch.h"
+#include "FileIngestor.h"
+
+#include <cstring>
+#include <deque>
+
+#ifdef TOKENIZER_IO_URING
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+FileIngestor::FileIngestor(WorkerPool* inPool) :
+    pool((NULL != inPool) ? inPool : &WorkerPool::shared()),
+    ioUringWorks(true),
+    ioUringUsed(false),
+    queueDepth(64),
+    useHugePages(false)
+{
+}
+
+bool FileIngestor::usesIoUring() const
+{
+#ifdef TOKENIZER_IO_URING
+    return ioUringUsed && ioUringWorks;
+#else
+    return false;
+#endif
+}
+
+// Map or read one file, the way readInFile does - but with the huge page setting.
+static void readOneFile(const boost::filesystem::path& filePath, ReadFileData& fileData, bool hugePages)
+{
+    if (hugePages && boost::filesystem::file_size(filePath) >= ReadFileData::mapThreshold) fileData.mapInFile(filePath, true);
+    else fileData.readInFile(filePath);
+}
+
+void FileIngestor::readAll(span<const boost::filesystem::path> filePaths, span<ReadFileData*> fileData,
+    const function<void(size_t index, const string& error)>& ready, unsigned threadCount)
+{
+#ifdef TOKENIZER_IO_URING
+    if (ioUringWorks && readAllWithIoUring(filePaths, fileData, ready)) return;
+#endif
+
+    pool->parallelFor(filePaths.size(), [this, &filePaths, &fileData, &ready](size_t index) {
+            string error;
+            try
+            {
+                readOneFile(filePaths[index], *fileData[index], useHugePages);
+            }
+            catch (exception& ex)
+            {
+                error = ex.what();
+            }
+
+            ready(index, error);
+        }, threadCount);
+}
+
+#ifdef TOKENIZER_IO_URING
+
+namespace
+{
+    // The files that have been read, waiting for a ready call.  The helper jobs on the WorkerPool can start after
+    // readAll has returned, so like ParallelForState they only touch this (kept alive by the shared_ptr).
+    struct ReadyFiles
+    {
+        const function<void(size_t index, const string& error)>*   ready;
+
+        mutex                           lock;
+        condition_variable              allDone;
+        deque<pair<size_t, string>>     waiting;
+        size_t                          done;
+        exception_ptr                   firstException;
+
+        ReadyFiles(const function<void(size_t, const string&)>& inReady) : ready(&inReady), done(0) {}
+
+        // Make ready calls until there are no files waiting, or just one.
+        void runAvailable(bool justOne = false)
+        {
+            for (;;)
+            {
+                pair<size_t, string> file;
+                {
+                    lock_guard<mutex> guard(lock);
+                    if (waiting.empty()) return;
+                    file = std::move(waiting.front());
+                    waiting.pop_front();
+                }
+
+                try
+                {
+                    (*ready)(file.first, file.second);
+                }
+                catch (...)
+                {
+                    lock_guard<mutex> guard(lock);
+                    if (!firstException) firstException = current_exception();
+                }
+
+                {
+                    lock_guard<mutex> guard(lock);
+                    done++;
+                }
+                allDone.notify_all();
+
+                if (justOne) return;
+            }
+        }
+
+        bool hasWaiting()
+        {
+            lock_guard<mutex> guard(lock);
+            return !waiting.empty();
+        }
+    };
+
+    // Just enough of io_uring for reads - the rings are used directly, there is no liburing.
+    class ReadRing
+    {
+    protected:
+        int             ringFd;
+
+        void*           sqRing;
+        size_t          sqRingSize;
+        void*           cqRing;
+        size_t          cqRingSize;
+        io_uring_sqe*   sqes;
+        size_t          sqesSize;
+
+        unsigned*       sqHead;
+        unsigned*       sqTail;
+        unsigned        sqMask;
+        unsigned*       sqArray;
+        unsigned        sqEntries;
+
+        unsigned*       cqHead;
+        unsigned*       cqTail;
+        unsigned        cqMask;
+        io_uring_cqe*   cqes;
+
+        unsigned        toSubmit;
+
+    public:
+        ReadRing() : ringFd(-1), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqes((io_uring_sqe*)MAP_FAILED), toSubmit(0) {}
+
+        ~ReadRing()
+        {
+            if (MAP_FAILED != (void*)sqes) munmap(sqes, sqesSize);
+            if (MAP_FAILED != cqRing && cqRing != sqRing) munmap(cqRing, cqRingSize);
+            if (MAP_FAILED != sqRing) munmap(sqRing, sqRingSize);
+            if (0 <= ringFd) close(ringFd);
+        }
+
+        bool setup(unsigned depth)
+        {
+            io_uring_params params;
+            memset(&params, 0, sizeof(params));
+
+            ringFd = (int)syscall(__NR_io_uring_setup, depth, &params);
+            if (ringFd < 0) return false;
+
+            sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool singleMap = 0 != (params.features & IORING_FEAT_SINGLE_MMAP);
+            if (singleMap) sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+
+            sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+            if (MAP_FAILED == sqRing) return false;
+
+            cqRing = singleMap ? sqRing : mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+            if (MAP_FAILED == cqRing) return false;
+
+            sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = (io_uring_sqe*)mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+            if (MAP_FAILED == (void*)sqes) return false;
+
+            char* sq = (char*)sqRing;
+            sqHead = (unsigned*)(sq + params.sq_off.head);
+            sqTail = (unsigned*)(sq + params.sq_off.tail);
+            sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+            sqArray = (unsigned*)(sq + params.sq_off.array);
+            sqEntries = params.sq_entries;
+
+            char* cq = (char*)cqRing;
+            cqHead = (unsigned*)(cq + params.cq_off.head);
+            cqTail = (unsigned*)(cq + params.cq_off.tail);
+            cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+            cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+            return true;
+        }
+
+        // Add a read to the submission queue.  False if it is full.
+        bool queueRead(int fd, char* into, unsigned length, uint64_t offset, uint64_t userData)
+        {
+            unsigned tail = *sqTail;
+            if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) return false;
+
+            unsigned slot = tail & sqMask;
+            io_uring_sqe& sqe = sqes[slot];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_READ;
+            sqe.fd = fd;
+            sqe.addr = (uint64_t)(uintptr_t)into;
+            sqe.len = length;
+            sqe.off = offset;
+            sqe.user_data = userData;
+
+            sqArray[slot] = slot;
+            __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+            toSubmit++;
+            return true;
+        }
+
+        // Submit the queued reads, and wait until at least waitFor have finished.
+        bool submitAndWait(unsigned waitFor)
+        {
+            for (;;)
+            {
+                int submitted = (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor, IORING_ENTER_GETEVENTS, NULL, 0);
+                if (0 <= submitted)
+                {
+                    toSubmit -= min<unsigned>(toSubmit, (unsigned)submitted);
+                    return true;
+                }
+                if (EINTR != errno) return false;
+            }
+        }
+
+        // The next finished read.  result is the bytes read, or -errno.
+        bool nextCompletion(uint64_t& userData, int& result)
+        {
+            unsigned head = *cqHead;
+            if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) return false;
+
+            io_uring_cqe& cqe = cqes[head & cqMask];
+            userData = cqe.user_data;
+            result = cqe.res;
+
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+    };
+
+    struct PendingRead
+    {
+        int         fd;
+        char*       into;
+        size_t      size;
+        size_t      done;
+        bool        inRing;
+    };
+}
+
+bool FileIngestor::readAllWithIoUring(span<const boost::filesystem::path> filePaths, span<ReadFileData*> fileData,
+    const function<void(size_t index, const string& error)>& ready)
+{
+    ReadRing ring;
+    if (!ring.setup(max(queueDepth, 1u)))
+    {
+        // Not in this kernel, or not allowed (containers often block it)
+        ioUringWorks = false;
+        return false;
+    }
+    ioUringUsed = true;
+
+    auto readyFiles = make_shared<ReadyFiles>(ready);
+    auto handOn = [this, &readyFiles](size_t index, string error) {
+        {
+            lock_guard<mutex> guard(readyFiles->lock);
+            readyFiles->waiting.emplace_back(index, std::move(error));
+        }
+        auto files = readyFiles;
+        pool->submit([files]() { files->runAvailable(true); });
+    };
+
+    vector<PendingRead> reads(filePaths.size());
+    size_t inFlight = 0;
+
+    // A read failed in the ring - try it the ordinary way, that gives the usual error if the file really can not be read.
+    auto readDirectly = [this, &filePaths, &fileData, &handOn](size_t index) {
+        string error;
+        try
+        {
+            readOneFile(filePaths[index], *fileData[index], useHugePages);
+        }
+        catch (exception& ex)
+        {
+            error = ex.what();
+        }
+        handOn(index, std::move(error));
+    };
+
+    auto queueNext = [&ring, &reads](size_t index) {
+        PendingRead& read = reads[index];
+        size_t length = min<size_t>(read.size - read.done, 1u << 30);
+        return ring.queueRead(read.fd, read.into + read.done, (unsigned)length, read.done, index);
+    };
+
+    auto reapFinished = [&]() {
+        uint64_t index;
+        int result;
+        while (ring.nextCompletion(index, result))
+        {
+            PendingRead& read = reads[index];
+            if (0 < result) read.done += result;
+
+            // A short read, queue the rest
+            bool shortRead = 0 < result && read.done < read.size;
+            if (shortRead && queueNext(index)) continue;
+
+            inFlight--;
+            read.inRing = false;
+            close(read.fd);
+
+            // Failed, or the rest could not be queued (the submission queue is full) - never hand on part of a file.
+            if (result < 0 || shortRead)
+            {
+                readDirectly(index);
+            }
+            else
+            {
+                // 0 is the end of the file - it got shorter since it was sized
+                fileData[index]->finishRead(read.done);
+                handOn(index, string());
+            }
+        }
+    };
+
+    // Wait for a read to finish, making a ready call while the reads run if there is one to make.
+    auto waitForOne = [&]() {
+        if (readyFiles->hasWaiting())
+        {
+            ring.submitAndWait(0);
+            readyFiles->runAvailable(true);
+            reapFinished();
+            return true;
+        }
+
+        bool waited = ring.submitAndWait(1);
+        reapFinished();
+        return waited;
+    };
+
+    bool ringWorks = true;
+    for (size_t index = 0; index < filePaths.size(); index++)
+    {
+        int fd = open(filePaths[index].c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat status;
+        if (fd < 0 || 0 != fstat(fd, &status) || !S_ISREG(status.st_mode) || (size_t)status.st_size >= ReadFileData::mapThreshold || !ringWorks)
+        {
+            // Mapped, or not a plain file (the error comes from the ordinary read)
+            if (0 <= fd) close(fd);
+            readDirectly(index);
+            continue;
+        }
+
+        PendingRead& read = reads[index];
+        read.fd = fd;
+        read.size = (size_t)status.st_size;
+        read.done = 0;
+        read.into = fileData[index]->startRead(read.size);
+
+        if (0 == read.size)
+        {
+            close(fd);
+            handOn(index, string());
+            continue;
+        }
+
+        while (ringWorks && (inFlight >= queueDepth || !queueNext(index))) ringWorks = waitForOne();
+
+        if (ringWorks)
+        {
+            read.inRing = true;
+            inFlight++;
+        }
+        else
+        {
+            close(fd);
+            readDirectly(index);
+        }
+    }
+
+    while (0 < inFlight && waitForOne()) {}
+
+    // io_uring_enter failing with reads in the ring should not happen - read what is left the ordinary way.  Those reads
+    // could still finish into their buffers, so each ReadFileData lets go of its buffer (it is never freed) first.
+    for (size_t index = 0; 0 < inFlight && index < reads.size(); index++)
+    {
+        PendingRead& read = reads[index];
+        if (!read.inRing) continue;
+
+        read.inRing = false;
+        inFlight--;
+        close(read.fd);
+        fileData[index]->abandonBuffer();
+        readDirectly(index);
+    }
+
+    readyFiles->runAvailable();
+
+    unique_lock<mutex> lock(readyFiles->lock);
+    readyFiles->allDone.wait(lock, [&readyFiles, &filePaths] { return readyFiles->done == filePaths.size(); });
+
+    if (readyFiles->firstException) rethrow_exception(readyFiles->firstException);
+    return true;
+}
+
+#endif // TOKENIZER_IO_URING
@@ -0,0 +1,64 @@
+#ifndef FILE_INGESTOR_H_INCLUDED
+#define FILE_INGESTOR_H_INCLUDED
+
+#include <functional>
+#include <span>
+#include <string>
+
+#include "ReadFileData.h"
+#include "WorkerPool.h"
+
+// io_uring is used on Linux, when the kernel headers have it.  Define TOKENIZER_NO_IO_URING to leave it out.
+#if defined(__linux__) && __has_include(<linux/io_uring.h>) && !defined(TOKENIZER_NO_IO_URING)
+#define TOKENIZER_IO_URING 1
+#endif
+
+/*
+* Reads many files for Tokenizer::tokenizeAll, handing each one on as soon as it is in memory.
+*
+*   FileIngestor ingestor;
+*   ingestor.readAll(filePaths, fileData, [](size_t index, const string& error) { ... tokenize fileData[index] ... });
+*
+* Files of ReadFileData::mapThreshold bytes and up are mapped, with the sequential and will need hints.
+* The smaller ones are read into the ReadFileData buffers:
+*   With io_uring the reads are all queued at once (queueDepth at a time) from the calling thread, so a cold cache
+*   has many reads in flight.  As each one finishes ready is run on the WorkerPool.
+*   Without it (not Linux, or the kernel does not allow it) the files are read and handed on by parallelFor,
+*   one file at a time on each thread.
+*
+* ready is called once for each file, on any thread and for several files at once.  error is empty when the file
+* was read.  readAll returns when every ready call has returned.
+*/
+class EXPORT FileIngestor
+{
+protected:
+    WorkerPool*     pool;
+
+    // False once io_uring could not be set up, so it is not tried again.
+    bool            ioUringWorks;
+
+    // Set when a readAll has set up io_uring
+    bool            ioUringUsed;
+
+    bool readAllWithIoUring(span<const boost::filesystem::path> filePaths, span<ReadFileData*> fileData,
+        const std::function<void(size_t index, const std::string& error)>& ready);
+
+public:
+    // The most reads in flight at once
+    unsigned        queueDepth;
+
+    // Ask for transparent huge pages for the mapped files
+    bool            useHugePages;
+
+    // pool NULL uses WorkerPool::shared()
+    FileIngestor(WorkerPool* inPool = NULL);
+
+    // True once a readAll has read with io_uring - false before the first readAll, and after io_uring could not be set up.
+    bool usesIoUring() const;
+
+    // Read filePaths[i] into fileData[i], and call ready(i, error).  threadCount is for the parallelFor fallback, 0 for all.
+    void readAll(span<const boost::filesystem::path> filePaths, span<ReadFileData*> fileData,
+        const std::function<void(size_t index, const std::string& error)>& ready, unsigned threadCount = 0);
+};
+
+#endif // FILE_INGESTOR_H_INCLUDED
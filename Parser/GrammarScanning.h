@@ -0,0 +1,293 @@
+#ifndef GRAMMAR_SCANNING_H_INCLUDED
+#define GRAMMAR_SCANNING_H_INCLUDED
+
+#include <chrono>
+
+#include "Tokenizer.h"
+
+/*
+* The tokenizer scanning loop, and the grammars it can be compiled with.
+*
+* scanTokens<Grammar> is the loop.  A Grammar needs:
+*   Grammar(Tokenizer& tokenizer)
+*   bool hasWhitespace() const
+*   MatchInfo skipWhitespace(const char* start, const char* end) const
+*   MatchInfo match(const char* start, const char* end) const     - start is the first character of the token
+*   void setTokenType(const MatchInfo& info, Token& token) const
+*
+* RuntimeGrammar uses the TokenizerGrammar's dispatchTable and idToTokenType, so any tokenReadingMap works.
+* StaticGrammar is built at compile time from GrammarRule entries and a constexpr id to typeFlags function,
+* so the matcher calls are direct calls and the type lookup is an array index.
+*/
+
+// A rule that runs a matcher.  The same as TokenMatching(matcher, special) in the tokenReadingMap.
+template <char Lookup, MatchInfo (*Matcher)(const char*, const char*, char), char Special = 0>
+struct GrammarRule
+{
+    static constexpr char lookup = Lookup;
+
+    static MatchInfo match(const char* start, const char* end)
+    {
+        return (*Matcher)(start, end, Special);
+    }
+
+    static TokenMatching* newTokenMatching() { return new TokenMatching(Matcher, Special); }
+};
+
+// A rule for a single character token.  The same as TokenMatching(character) in the tokenReadingMap.
+template <char Lookup>
+struct SingleCharacterRule
+{
+    static constexpr char lookup = Lookup;
+
+    static MatchInfo match(const char*, const char*)
+    {
+        MatchInfo info;
+        info.id = Lookup;
+        info.length = 1;
+        info.chars = 1;
+        return info;
+    }
+
+    static TokenMatching* newTokenMatching() { return new TokenMatching(Lookup); }
+};
+
+// The first Rule with this lookup, or sizeof...(Rules) if there isn't one.
+template <class... Rules>
+constexpr size_t findGrammarRule(char lookup)
+{
+    constexpr char lookups[] = { Rules::lookup... };
+    for (size_t i = 0; i < sizeof...(Rules); i++)
+    {
+        if (lookup == lookups[i]) return i;
+    }
+    return sizeof...(Rules);
+}
+
+template <class... Rules>
+constexpr array<unsigned char, 256> makeGrammarRuleIndex()
+{
+    static_assert(sizeof...(Rules) < 255, "Too many grammar rules");
+
+    array<unsigned char, 256> index{};
+    for (int i = 0; i < 256; i++) index[i] = (unsigned char)findGrammarRule<Rules...>(lookupCharacter((char)i));
+    return index;
+}
+
+template <long (*TypeFromId)(char id)>
+constexpr array<long, 256> makeGrammarIdTypes()
+{
+    array<long, 256> types{};
+    for (int i = 0; i < 256; i++) types[i] = TypeFromId((char)i);
+    return types;
+}
+
+template <long (*TypeFromId)(char id), class... Rules>
+class StaticGrammar
+{
+protected:
+    static constexpr size_t noRule = sizeof...(Rules);
+
+    // The rule for each first character, and the typeFlags for each MatchInfo.id
+    static constexpr array<unsigned char, 256> ruleIndex = makeGrammarRuleIndex<Rules...>();
+    static constexpr array<long, 256> idTypes = makeGrammarIdTypes<TypeFromId>();
+    static constexpr size_t whitespaceRule = findGrammarRule<Rules...>(' ');
+
+    template <size_t... I>
+    static MatchInfo matchRule(size_t rule, const char* start, const char* end, index_sequence<I...>)
+    {
+        MatchInfo info;
+        ((rule == I ? (info = Rules::match(start, end), true) : false) || ...);
+        return info;
+    }
+
+public:
+    StaticGrammar(Tokenizer&) {}
+
+    constexpr bool hasWhitespace() const { return noRule != whitespaceRule; }
+
+    MatchInfo skipWhitespace(const char* start, const char* end) const
+    {
+        return matchRule(whitespaceRule, start, end, index_sequence_for<Rules...>());
+    }
+
+    MatchInfo match(const char* start, const char* end) const
+    {
+        return matchRule(ruleIndex[(unsigned char)*start], start, end, index_sequence_for<Rules...>());
+    }
+
+    void setTokenType(const MatchInfo& info, Token& token) const
+    {
+        token.typeFlags = idTypes[(unsigned char)info.id];
+    }
+
+    // The same rules as a tokenReadingMap for the Tokenizer constructor.
+    static map<char, TokenMatching*>* newTokenReadingMap()
+    {
+        return new map<char, TokenMatching*>({ make_pair(Rules::lookup, Rules::newTokenMatching())... });
+    }
+};
+
+class RuntimeGrammar
+{
+protected:
+    const TokenizerGrammar& grammar;
+
+public:
+    RuntimeGrammar(Tokenizer& tokenizer) : grammar(*tokenizer.grammar) {}
+
+    bool hasWhitespace() const { return NULL != grammar.whitespaceMatching; }
+
+    MatchInfo skipWhitespace(const char* start, const char* end) const
+    {
+        TokenMatching* whitespace = grammar.whitespaceMatching;
+        return (*whitespace->tokenMatcher)(start, end, whitespace->matchOrSpecial);
+    }
+
+    MatchInfo match(const char* start, const char* end) const
+    {
+        MatchInfo info;
+
+        TokenMatching* match = grammar.dispatchTable[(unsigned char)*start];
+        if (NULL != match)
+        {
+            if (NULL != match->tokenMatcher)
+            {
+                info = (*match->tokenMatcher)(start, end, match->matchOrSpecial);
+            }
+            else
+            {
+                // Single character match - matchOrSpecial goes too the inf.id
+                info.id = match->matchOrSpecial;
+                info.length = 1;
+                info.chars = 1;
+            }
+        }
+
+        return info;
+    }
+
+    void setTokenType(const MatchInfo& info, Token& token) const
+    {
+        (*grammar.idToTokenType)(info, token);
+    }
+};
+
+// Counts a scan into a TokenizerStats for Tokenizer::addStatistics - see TokenizerStats.h.
+// ScanRecorder<false> does nothing, so without TOKENIZER_STATS the scanning loop is the same as with no recorder.
+template <bool Enabled>
+class ScanRecorder
+{
+public:
+    ScanRecorder(Tokenizer&) {}
+
+    void startMatch() {}
+    void matched(char, size_t) {}
+    void madeToken(const Token&) {}
+};
+
+template <>
+class ScanRecorder<true>
+{
+protected:
+    Tokenizer&                          tokenizer;
+    TokenizerStats                      counts;
+    chrono::steady_clock::time_point    matchStart;
+
+public:
+    ScanRecorder(Tokenizer& inTokenizer) : tokenizer(inTokenizer) { counts.scans = 1; }
+    ~ScanRecorder() { tokenizer.addStatistics(counts); }
+
+    void startMatch() { matchStart = chrono::steady_clock::now(); }
+
+    // key is the tokenReadingMap key of the matcher
+    void matched(char key, size_t length)
+    {
+        TokenizerStats::Matcher& matcher = counts.matchers[(unsigned char)key];
+        matcher.calls++;
+        matcher.bytes += length;
+        matcher.nanoseconds += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - matchStart).count();
+    }
+
+    void madeToken(const Token& token) { counts.tokenTypes[(size_t)token.typeFlags % TokenizerStats::typeSlots]++; }
+};
+
+// Find the tokens that start from runner up to stopAt, and add them to tokens.  Tokens can run past stopAt up to end.
+// position is the line and character at runner, and it is updated to the stopping point.
+// runner is left at the start of the first token at or after stopAt, or at end.
+// Without TrackPositions the tokens are all at line 0 character 0 and position is not changed - see Tokenizer::lazyPositions.
+template <class Grammar, bool TrackPositions = true>
+bool scanTokens(Tokenizer& tokenizer, token_vector& tokens, const char*& runner, const char* stopAt, const char* end, ScanPosition& position)
+{
+    Grammar grammar(tokenizer);
+
+    if (!grammar.hasWhitespace()) return false;
+
+    ScanRecorder<TokenizerStats::enabled> recorder(tokenizer);
+
+    long lineNumber = TrackPositions ? position.lineNumber : 0;
+    long characterNumber = TrackPositions ? position.characterNumber : 0;
+
+    while (runner < end)
+    {
+        // Skip over the whitespace.
+        recorder.startMatch();
+        MatchInfo info = grammar.skipWhitespace(runner, end);
+        recorder.matched(' ', info.length);
+
+        if constexpr (TrackPositions) info.advance(lineNumber, characterNumber);
+        runner += info.length;
+
+        // Trailing whitespace - nothing left to look up, or the rest belongs to the next scan.
+        if (runner >= stopAt) break;
+
+        Token& token = tokens.emplace_back(lineNumber, characterNumber);
+
+        recorder.startMatch();
+        info = grammar.match(runner, end);
+        recorder.matched(lookupCharacter(*runner), info.length);
+
+        if (0 < info.length && 0 != info.id)
+        {
+            token.tokenString = string_view(runner, info.length);
+            token.hasEscape = info.hasEscape;
+            grammar.setTokenType(info, token);
+
+            runner += info.length;
+            if constexpr (TrackPositions) info.advance(lineNumber, characterNumber);
+        }
+        else if (isPunctuationChar(*runner))
+        {
+            // Bad / unsupported punctuation
+            token.typeFlags = Token::badPunctuation;
+            token.tokenString = string_view(runner++, 1);
+            if constexpr (TrackPositions) characterNumber++;
+        }
+        else
+        {
+            // Not matched - make it a bad token from the current location to the next whitespace
+            // This should not happen unless the char = 0 map entry was not set.
+            failTokenToNextWhitespace(token, Token::badUnknown, characterNumber, lineNumber, runner, end);
+            if constexpr (!TrackPositions) characterNumber = 0;
+        }
+
+        recorder.madeToken(token);
+    }
+
+    if constexpr (TrackPositions)
+    {
+        position.lineNumber = lineNumber;
+        position.characterNumber = characterNumber;
+    }
+
+    return true;
+}
+
+template <class Grammar>
+void TokenizerGrammar::useStaticGrammar()
+{
+    scanner = &scanTokens<Grammar>;
+    offsetScanner = &scanTokens<Grammar, false>;
+}
+
+#endif // GRAMMAR_SCANNING_H_INCLUDED
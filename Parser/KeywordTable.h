@@ -0,0 +1,100 @@
+#ifndef KEYWORD_TABLE_H_INCLUDED
+#define KEYWORD_TABLE_H_INCLUDED
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+struct KeywordType
+{
+    std::string_view    text;
+    long                typeFlags;
+    uint16_t            id;         // Which keyword it is, for Token::keywordId - 0 is not a keyword
+};
+
+/*
+* A perfect hash from keyword text to typeFlags, built at compile time.
+*
+*   static constexpr KeywordTable<2> keywords({ { { ":if"sv, Token::keyword, 1 }, { ":self"sv, Token::selfCall, 2 } } });
+*   token.typeFlags = keywords.find(token.tokenString, token.typeFlags);
+*   const KeywordType* keyword = keywords.lookup(token.tokenString);    // NULL if it is not a keyword
+*
+* The hash is of the length and the second and last characters, so a lookup is one multiply, one slot and one
+* compare - the compare is still needed since text that is not a keyword lands in some slot too.
+* The constructor searches for a multiplier that puts every keyword in its own slot.  If there isn't one the
+* table fails to compile - keywords that differ only in the middle need a different hash.
+*/
+template <size_t Count>
+class KeywordTable
+{
+protected:
+    // At least 4 slots per keyword, so a multiplier without collisions is quick to find
+    static constexpr size_t tableBits = (Count <= 4) ? 4 : (Count <= 8) ? 5 : (Count <= 16) ? 6 : (Count <= 32) ? 7 : 8;
+    static constexpr size_t tableSize = size_t(1) << tableBits;
+
+    static_assert(Count <= tableSize / 4, "Too many keywords for KeywordTable");
+
+    std::array<KeywordType, tableSize>  slots;
+    uint32_t                            multiplier;
+
+    static constexpr uint32_t key(std::string_view text)
+    {
+        return (uint32_t)(unsigned char)text[1] | ((uint32_t)(unsigned char)text.back() << 8) | ((uint32_t)text.size() << 16);
+    }
+
+    constexpr size_t slotOf(std::string_view text) const
+    {
+        return (key(text) * multiplier) >> (32 - tableBits);
+    }
+
+public:
+    constexpr KeywordTable(const std::array<KeywordType, Count>& keywords) :
+        slots{},
+        multiplier(0)
+    {
+        for (const KeywordType& keyword : keywords)
+        {
+            if (keyword.text.size() < 2) throw std::logic_error("Keywords need at least 2 characters");
+            if (0 == keyword.id) throw std::logic_error("Keyword id 0 is for tokens that are not keywords");
+        }
+
+        // Odd multipliers spread from the golden ratio - the first one without a collision is used.
+        for (uint32_t tryMultiplier = 0x9E3779B1; ; tryMultiplier += 0x6A09E668)
+        {
+            multiplier = tryMultiplier;
+
+            std::array<bool, tableSize> used{};
+            bool collision = false;
+            for (size_t i = 0; !collision && i < Count; i++)
+            {
+                size_t slot = slotOf(keywords[i].text);
+                collision = used[slot];
+                used[slot] = true;
+            }
+
+            if (!collision) break;
+            if (0x9E3779B1 + 0x6A09E668 * 4096u == tryMultiplier) throw std::logic_error("No perfect hash for the keywords");
+        }
+
+        for (const KeywordType& keyword : keywords) slots[slotOf(keyword.text)] = keyword;
+    }
+
+    // The keyword that is text, or NULL if text is not one of the keywords.
+    constexpr const KeywordType* lookup(std::string_view text) const
+    {
+        if (text.size() < 2) return NULL;
+
+        const KeywordType& slot = slots[slotOf(text)];
+        return (slot.text == text) ? &slot : NULL;
+    }
+
+    // The typeFlags for text, or notKeyword if text is not one of the keywords.
+    constexpr long find(std::string_view text, long notKeyword) const
+    {
+        const KeywordType* keyword = lookup(text);
+        return (NULL != keyword) ? keyword->typeFlags : notKeyword;
+    }
+};
+
+#endif // KEYWORD_TABLE_H_INCLUDED
@@ -0,0 +1,123 @@
+#include "pch.h"
+#include "NumericValues.h"
+
+#include <charconv>
+#include <cmath>
+
+// A double that from_chars says is out of range - the sign, and if the exponent was too big or too small.
+static double outOfRangeDouble(string_view text)
+{
+    bool negative = !text.empty() && '-' == text.front();
+
+    size_t exponentAt = text.find_first_of("eE");
+    bool tiny = string_view::npos != exponentAt && exponentAt + 1 < text.size() && '-' == text[exponentAt + 1];
+
+    double magnitude = tiny ? 0.0 : HUGE_VAL;
+    return negative ? -magnitude : magnitude;
+}
+
+NumericValue NumericValues::parse(string_view text, long typeFlags)
+{
+    NumericValue value;
+
+    const char* start = text.data();
+    const char* end = start + text.size();
+
+    if (Token::hexNumber == typeFlags)
+    {
+        // Past the 0x.  Only the last 16 digits fit, the ones before them are overflow.
+        start += min<size_t>(2, text.size());
+        if (16 < end - start)
+        {
+            value.flags |= NumericValue::overflow;
+            start = end - 16;
+        }
+
+        uint64_t bits = 0;
+        auto result = from_chars(start, end, bits, 16);
+        if (errc() != result.ec || end != result.ptr) value.flags |= NumericValue::notParsed;
+
+        value.integerValue = (int64_t)bits;
+        return value;
+    }
+
+    // No . or e - an integer
+    bool isInteger = true;
+    for (const char* runner = start; runner < end && isInteger; runner++) isInteger = '.' != *runner && 'e' != *runner && 'E' != *runner;
+
+    if (isInteger)
+    {
+        auto result = from_chars(start, end, value.integerValue);
+        if (errc() == result.ec && end == result.ptr) return value;
+
+        value.integerValue = 0;
+        if (errc::result_out_of_range != result.ec)
+        {
+            value.flags |= NumericValue::notParsed;
+            return value;
+        }
+
+        // Too big for int64 - give the nearest double instead
+        value.flags |= NumericValue::overflow;
+    }
+
+    value.kind = NumericValue::floating;
+    value.floatingValue = 0.0;
+
+    auto result = from_chars(start, end, value.floatingValue);
+    if (errc::result_out_of_range == result.ec)
+    {
+        value.flags |= NumericValue::overflow;
+        value.floatingValue = outOfRangeDouble(text);
+    }
+    else if (errc() != result.ec || end != result.ptr)
+    {
+        value.flags |= NumericValue::notParsed;
+        value.floatingValue = 0.0;
+    }
+
+    return value;
+}
+
+void NumericValues::record(const token_vector& tokens, size_t first, size_t last)
+{
+    last = min(last, tokens.size());
+    for (size_t i = first; i < last; i++)
+    {
+        const Token& token = tokens[i];
+        if (Token::number != token.typeFlags && Token::hexNumber != token.typeFlags) continue;
+
+        NumericValue& value = values.emplace_back(parse(token.tokenString, token.typeFlags));
+        value.tokenIndex = (uint32_t)i;
+    }
+}
+
+void NumericValues::append(const NumericValues& more)
+{
+    values.insert(values.end(), more.values.begin(), more.values.end());
+}
+
+void NumericValues::replace(const token_vector& tokens, size_t first, size_t oldLast, size_t newLast)
+{
+    auto byIndex = [](const NumericValue& value, size_t index) { return value.tokenIndex < index; };
+    auto from = lower_bound(values.begin(), values.end(), first, byIndex);
+    auto to = lower_bound(from, values.end(), oldLast, byIndex);
+
+    ptrdiff_t moved = (ptrdiff_t)newLast - (ptrdiff_t)oldLast;
+    for (auto value = to; value != values.end(); ++value) value->tokenIndex = (uint32_t)(value->tokenIndex + moved);
+
+    NumericValues scanned;
+    scanned.record(tokens, first, newLast);
+
+    size_t at = from - values.begin();
+    values.erase(from, to);
+    values.insert(values.begin() + at, scanned.values.begin(), scanned.values.end());
+}
+
+const NumericValue* NumericValues::find(size_t tokenIndex) const
+{
+    auto found = lower_bound(values.begin(), values.end(), tokenIndex,
+        [](const NumericValue& value, size_t index) { return value.tokenIndex < index; });
+
+    return (values.end() != found && tokenIndex == found->tokenIndex) ? &*found : NULL;
+}
@@ -0,0 +1,89 @@
+#ifndef NUMERIC_VALUES_H_INCLUDED
+#define NUMERIC_VALUES_H_INCLUDED
+
+#include "Tokenizer.h"
+
+#include <cstdint>
+
+// The value of one number or hexNumber token.
+struct NumericValue
+{
+    enum Kind : uint8_t
+    {
+        integer,
+        floating,
+    };
+
+    enum Flags : uint8_t
+    {
+        none = 0,
+        overflow = 1,       // Out of range - see NumericValues
+        notParsed = 2,      // Not a number from_chars takes, the value is 0
+    };
+
+    uint32_t    tokenIndex;
+    Kind        kind;
+    uint8_t     flags;
+    union
+    {
+        int64_t     integerValue;
+        double      floatingValue;
+    };
+
+    NumericValue() : tokenIndex(0), kind(integer), flags(none), integerValue(0) {}
+
+    bool hasOverflow() const { return 0 != (flags & overflow); }
+    double asDouble() const { return (integer == kind) ? (double)integerValue : floatingValue; }
+};
+
+/*
+* The values of the number tokens, parsed once by the Tokenizer instead of again by each later stage.
+*
+*   NumericValues numbers;
+*   tokenizer.numericValues = &numbers;
+*   tokenizer.tokenize(filePath);
+*   const NumericValue* value = numbers.find(tokenIndex);     // NULL if tokens[tokenIndex] is not a number
+*
+* Decimal numbers without a . or an e are integers, the rest are floating (5.5e2, -.2e-1).  0x numbers are
+* integers from their hex digits, so 0xFFFFFFFFFFFFFFFF is -1.  The parse is std::from_chars, so there is no
+* locale and nothing is copied.  Out of range values have the overflow flag:
+*   a decimal integer past int64 is given as floating, the nearest double
+*   a floating value past double is +/- infinity, or 0 when it is too small
+*   a hex number over 16 digits keeps the low 64 bits
+*
+* Only numbers are in the table, in token order, so it is small - find is a binary search.
+* The indexes are into the Tokenizer's tokens, and Tokenizer::retokenize of its tokens keeps them up to date.
+* record can fill a table for any other token_vector.
+*/
+class EXPORT NumericValues
+{
+protected:
+    vector<NumericValue>    values;
+
+public:
+    // Parse one token's text.  typeFlags says if it is hex.
+    static NumericValue parse(string_view text, long typeFlags);
+
+    // Add the number tokens from first up to last.  They must come after the ones already in the table.
+    void record(const token_vector& tokens, size_t first = 0, size_t last = SIZE_MAX);
+
+    // Add the values of a table for the tokens just after this one's - for tables filled a slice at a time.
+    void append(const NumericValues& more);
+
+    // The tokens from first up to oldLast were replaced by the ones in tokens from first up to newLast - see
+    // Tokenizer::retokenize.  Their values are parsed again, and the indexes after them are moved.
+    void replace(const token_vector& tokens, size_t first, size_t oldLast, size_t newLast);
+
+    // The value of tokens[tokenIndex], NULL if it is not a number.
+    const NumericValue* find(size_t tokenIndex) const;
+
+    size_t size() const { return values.size(); }
+    bool empty() const { return values.empty(); }
+    const NumericValue& operator[](size_t index) const { return values[index]; }
+    vector<NumericValue>::const_iterator begin() const { return values.begin(); }
+    vector<NumericValue>::const_iterator end() const { return values.end(); }
+
+    void clear() { values.clear(); }
+};
+
+#endif // NUMERIC_VALUES_H_INCLUDED
@@ -1,28 +1,33 @@
 #include "pch.h"
 #include "ReadFileData.h"
+#include "SimdScanning.h"
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 void ReadFileData::dropMappedFileIfOpen(bool forceCleanupBuffer)
 {
 	if (forceCleanupBuffer)
 	{
-		if (bufferIsAllocated)
-		{
-			delete[] buffer;
-			bufferIsAllocated = false;
-		}
+		delete[] allocatedBuffer;
+		allocatedBuffer = NULL;
+		allocatedByteCount = 0;
 	}
 
-	if (!bufferIsAllocated)
-	{
-		// Cannot reuse if it isn't an allocated buffer, of if the forceCleanupBuffer just deleted the buffer
-		buffer = NULL;
-		byteCount = 0;
-		usedByteCount = 0;
-	}
+	// The data is gone either way, growBuffer goes back to the allocated buffer.
+	buffer = NULL;
+	usedByteCount = 0;
+
+	lineStarts.clear();
+	utf8Checked = false;
 
 	if (NULL != mappedFile)
 	{
 		mappedFile->close();
+		delete mappedFile;
 		mappedFile = NULL;
 	}
 }
@@ -34,17 +39,34 @@ ReadFileData::~ReadFileData()
 
 const char* ReadFileData::useExistingBuffer(const char* existingBuffer, size_t elemCount)
 {
-	dropMappedFileIfOpen(true);
+	dropMappedFileIfOpen(false);
 
-	usedByteCount = byteCount = elemCount * sizeof(char);
+	usedByteCount = elemCount * sizeof(char);
 
 	return buffer = existingBuffer;
 }
 
 
+size_t ReadFileData::mapThreshold = 64 * 1024;
+
 const char* ReadFileData::readInFile(boost::filesystem::path filePath)
 {
-	dropMappedFileIfOpen(true);
+	uintmax_t fileSize = boost::filesystem::file_size(filePath);
+	if (fileSize >= mapThreshold) return mapInFile(filePath);
+
+	ifstream input(filePath.string(), ios::binary);
+	if (!input) throw ios_base::failure("Could not open " + filePath.string());
+
+	char* readInto = startRead((size_t)fileSize);
+	input.read(readInto, (streamsize)fileSize);
+	finishRead((size_t)input.gcount());
+
+	return buffer;
+}
+
+const char* ReadFileData::mapInFile(const boost::filesystem::path& filePath, bool hugePages)
+{
+	dropMappedFileIfOpen(false);
 
 	mappedFile = new mapped_file_source();
 
@@ -55,32 +77,111 @@ const char* ReadFileData::readInFile(boost::filesystem::path filePath)
 	mappedFile->open(parms);
 
 
-	usedByteCount = byteCount = mappedFile->size();
+	usedByteCount = mappedFile->size();
+	buffer = (char*)mappedFile->data();
+
+#ifndef _WIN32
+	// Only hints - the mapping works the same if they are not supported.  The mapping starts on a page.
+	if (0 < usedByteCount)
+	{
+		void* start = (void*)buffer;
+		madvise(start, usedByteCount, MADV_SEQUENTIAL);
+		madvise(start, usedByteCount, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+		if (hugePages) madvise(start, usedByteCount, MADV_HUGEPAGE);
+#endif
+	}
+#endif
+
+	return buffer;
+}
+
+char* ReadFileData::startRead(size_t readByteCount)
+{
+	// Keep an allocated buffer from the last read
+	release();
+
+	growBuffer(max<size_t>(readByteCount, 1), 0);
+	usedByteCount = readByteCount;
+
+	return allocatedBuffer;
+}
+
+void ReadFileData::finishRead(size_t bytesRead)
+{
+	usedByteCount = min(usedByteCount, bytesRead);
+}
+
+// Make the buffer at least newByteCount, keeping the first keepByteCount bytes.
+void ReadFileData::growBuffer(size_t newByteCount, size_t keepByteCount)
+{
+	if (NULL != allocatedBuffer && newByteCount <= allocatedByteCount)
+	{
+		buffer = allocatedBuffer;
+		return;
+	}
+
+	newByteCount = (newByteCount + 1023) & ~(size_t)1023;       // make it even 1K blocks
+
+	char* newBuffer = new char[newByteCount];
+	if (0 < keepByteCount) memcpy(newBuffer, buffer, keepByteCount);
+
+	delete[] allocatedBuffer;
 
-	return buffer = (char*)mappedFile->data();
+	buffer = allocatedBuffer = newBuffer;
+	allocatedByteCount = newByteCount;
+}
+
+void ReadFileData::release()
+{
+	dropMappedFileIfOpen(false);
+	usedByteCount = 0;
+}
+
+void ReadFileData::abandonBuffer()
+{
+	release();
+	allocatedBuffer = NULL;
+	allocatedByteCount = 0;
 }
 
 const char* ReadFileData::readInFile(istream& input)
 {
-	dropMappedFileIfOpen(true);
+	// Keep an allocated buffer from the last read
+	release();
 
-	// Compute the size in char,  use 1M if not supplied.
-	long    inputSize = (long)input.gcount();
-	long    bufferSize = inputSize + 1;
-	if (0 >= inputSize) bufferSize = 1024 * 1024;
-	bufferSize = (bufferSize + 1024) & ~1023;       // make it even 1K blocks
+	// Start with 1M, and double the buffer until the whole stream is read.
+	growBuffer(1024 * 1024, 0);
 
-	if (byteCount < bufferSize * sizeof(char))
+	while (input.read(allocatedBuffer + usedByteCount, allocatedByteCount - usedByteCount))
 	{
-		if (NULL != buffer) delete[]buffer;
+		usedByteCount = allocatedByteCount;
+		growBuffer(allocatedByteCount * 2, usedByteCount);
+	}
+	usedByteCount += input.gcount();
 
-		buffer = new char[bufferSize];
-		bufferIsAllocated = true;
+	return buffer;
+}
+
+const char* ReadFileData::readNextChunk(istream& input, const char* keepFrom, size_t chunkSize)
+{
+	if (NULL == keepFrom)
+	{
+		release();
+		keepFrom = end();
 	}
-	//else // we have enough space just use the current buffer.
 
-	input.read((char*)buffer, bufferSize);
-	usedByteCount = input.gcount() * sizeof(char);
+	// Move the unused bytes to the start of the buffer
+	size_t keepByteCount = (NULL != keepFrom) ? end() - keepFrom : 0;
+	if (0 < keepByteCount && keepFrom != allocatedBuffer) memmove(allocatedBuffer, keepFrom, keepByteCount);
+
+	growBuffer(keepByteCount + chunkSize, keepByteCount);
+	usedByteCount = keepByteCount;
+	lineStarts.clear();
+	utf8Checked = false;
+
+	input.read(allocatedBuffer + usedByteCount, chunkSize);
+	usedByteCount += input.gcount();
 
 	return buffer;
 }
@@ -95,4 +196,148 @@ const char* ReadFileData::end()
 	}
 
 	return bufferEnd;
-}
\ No newline at end of file
+}
+
+void ReadFileData::buildLineIndex()
+{
+	lineStarts.clear();
+	if (NULL == buffer) return;
+
+	const char* runner = buffer;
+	const char* bufferEnd = end();
+
+	// Line 1 starts after the UTF8 BOM, like the tokenizer
+	if ((runner + 3 <= bufferEnd) && (0xEF == (unsigned char)*runner) && (0xBB == (unsigned char)*(runner + 1)) && (0xBF == (unsigned char)*(runner + 2)))
+	{
+		runner += 3;
+	}
+
+	// Roughly 40 characters per line
+	lineStarts.reserve((bufferEnd - runner) / 40 + 1);
+	lineStarts.push_back(runner - buffer);
+
+	while ((runner = scanKernels->findCharacter(runner, bufferEnd, '\n')) < bufferEnd)
+	{
+		lineStarts.push_back(++runner - buffer);
+	}
+}
+
+void ReadFileData::positionOf(const char* at, long& lineNumber, long& characterNumber)
+{
+	if (lineStarts.empty()) buildLineIndex();
+
+	lineNumber = characterNumber = 1;
+	if (lineStarts.empty()) return;
+
+	size_t offset = at - buffer;
+
+	// The last line start at or before offset
+	auto lineStart = upper_bound(lineStarts.begin(), lineStarts.end(), offset);
+	if (lineStart != lineStarts.begin()) --lineStart;
+
+	lineNumber = (long)(lineStart - lineStarts.begin()) + 1;
+	characterNumber = (long)(offset - *lineStart) + 1;
+}
+
+size_t ReadFileData::utf8SequenceLength(const unsigned char* at, const unsigned char* end)
+{
+	unsigned char lead = *at;
+
+	size_t length;
+	if (lead < 0xC2) return 0;				// A continuation byte, or an overlong 2 byte lead
+	else if (lead < 0xE0) length = 2;
+	else if (lead < 0xF0) length = 3;
+	else if (lead < 0xF5) length = 4;
+	else return 0;							// Past U+10FFFF
+
+	if ((size_t)(end - at) < length) return 0;
+	for (size_t i = 1; i < length; i++)
+	{
+		if (0x80 != (at[i] & 0xC0)) return 0;
+	}
+
+	// The second byte ranges that are overlong, surrogates or past U+10FFFF
+	if (0xE0 == lead && at[1] < 0xA0) return 0;
+	if (0xED == lead && at[1] >= 0xA0) return 0;
+	if (0xF0 == lead && at[1] < 0x90) return 0;
+	if (0xF4 == lead && at[1] >= 0x90) return 0;
+
+	return length;
+}
+
+void ReadFileData::checkUtf8()
+{
+	if (utf8Checked) return;
+	utf8Checked = true;
+
+	nonAsciiRuns.clear();
+	badUtf8Offsets.clear();
+	if (NULL == buffer) return;
+
+	const unsigned char* start = (const unsigned char*)buffer;
+	const unsigned char* bufferEnd = (const unsigned char*)end();
+	const unsigned char* runner = start;
+	size_t extraBytes = 0;
+
+	// Source code is mostly ASCII - skip it a vector at a time, and decode just the runs with the high bit set.
+	while ((runner = (const unsigned char*)scanKernels->skipAscii((const char*)runner, (const char*)bufferEnd)) < bufferEnd)
+	{
+		NonAsciiRun& run = nonAsciiRuns.emplace_back();
+		run.start = runner - start;
+		run.extraBytesBefore = extraBytes;
+
+		while (runner < bufferEnd && 0 != (0x80 & *runner))
+		{
+			size_t length = utf8SequenceLength(runner, bufferEnd);
+			if (0 == length)
+			{
+				badUtf8Offsets.push_back(runner - start);
+				length = 1;
+			}
+
+			extraBytes += length - 1;
+			runner += length;
+		}
+
+		run.end = runner - start;
+	}
+}
+
+size_t ReadFileData::extraBytesBetween(size_t from, size_t to)
+{
+	checkUtf8();
+	if (to <= from || nonAsciiRuns.empty()) return 0;
+
+	const unsigned char* start = (const unsigned char*)buffer;
+	const unsigned char* bufferEnd = (const unsigned char*)end();
+
+	// The extra bytes before an offset - the runs before its run, and the sequences of its run up to it.
+	auto extraBytesBefore = [this, start, bufferEnd](size_t offset) -> size_t {
+		auto run = upper_bound(nonAsciiRuns.begin(), nonAsciiRuns.end(), offset,
+			[](size_t at, const NonAsciiRun& nonAscii) { return at < nonAscii.start; });
+		if (run == nonAsciiRuns.begin()) return 0;
+		--run;
+
+		size_t extraBytes = run->extraBytesBefore;
+		const unsigned char* runner = start + run->start;
+		const unsigned char* stopAt = start + min(offset, run->end);
+		while (runner < stopAt)
+		{
+			size_t length = max<size_t>(utf8SequenceLength(runner, bufferEnd), 1);
+			extraBytes += length - 1;
+			runner += length;
+		}
+
+		return extraBytes;
+	};
+
+	return extraBytesBefore(to) - extraBytesBefore(from);
+}
+
+long ReadFileData::codePointColumn(const char* at, long characterNumber)
+{
+	if (characterNumber <= 1 || NULL == buffer) return characterNumber;
+
+	size_t offset = at - buffer;
+	return characterNumber - (long)extraBytesBetween(offset - (characterNumber - 1), offset);
+}
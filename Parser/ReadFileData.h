@@ -9,34 +9,111 @@ using namespace boost::iostreams;
 
 class EXPORT ReadFileData
 {
+public:
+	// A run of bytes with 0x80 set, with the extra bytes of the utf8 sequences before it.  The extra bytes are the
+	// ones after the first in each good sequence - the byte count less the extra bytes is the character count.
+	struct NonAsciiRun
+	{
+		size_t	start;
+		size_t	end;
+		size_t	extraBytesBefore;
+	};
+
 protected:
 	mapped_file_source* mappedFile;
-	bool bufferIsAllocated;
+
+	// The read buffer.  It is kept while the data is mapped or in an existing buffer, for the next read.
+	char*	allocatedBuffer;
+	size_t	allocatedByteCount;
+
 	const char* buffer;
 	size_t	usedByteCount;
-	size_t	byteCount;
+
+	// The offset of each line start, built when a position is first asked for.
+	vector<size_t>	lineStarts;
+
+	// Built by checkUtf8, the first time it is called
+	bool	utf8Checked;
+	vector<NonAsciiRun>	nonAsciiRuns;
+	vector<size_t>	badUtf8Offsets;
 
 	void dropMappedFileIfOpen(bool forceCleanupBuffer = false);
+	void growBuffer(size_t newByteCount, size_t keepByteCount);
 
 public:
 	ReadFileData() :
 		mappedFile(NULL),
-		bufferIsAllocated(false),
+		allocatedBuffer(NULL),
+		allocatedByteCount(0),
 		buffer(NULL),
 		usedByteCount(),
-		byteCount(0)
+		utf8Checked(false)
 	{
 	}
 
 	~ReadFileData();
 
+	// Use the caller's buffer - an allocated read buffer is kept for the next read.
 	const char* useExistingBuffer(const char* existingBuffer, size_t elemCount);
 
+	// Files smaller than mapThreshold are read into an allocated buffer (kept by release for the next one),
+	// the others are mapped with mapInFile.  Mapping a small file costs more than reading it.
+	static size_t mapThreshold;
+
 	const char* readInFile(boost::filesystem::path filePath);
 
+	// Map the file read-only, and tell the OS it will be read from start to end, soon.  hugePages asks for
+	// transparent huge pages too, where the file system supports them for file mappings.
+	const char* mapInFile(const boost::filesystem::path& filePath, bool hugePages = false);
+
+	// For an asynchronous read (FileIngestor): a buffer for byteCount bytes, then the bytes that were read.
+	char* startRead(size_t readByteCount);
+	void finishRead(size_t bytesRead);
+
+	// Let go of the allocated buffer without freeing it - an asynchronous read that could not be waited for may
+	// still write into it.  The next read allocates a new one.
+	void abandonBuffer();
+
 	const char* readInFile(istream& input);
 
+	// Read input a chunk at a time.  The bytes from keepFrom to end() are moved to the start of the buffer,
+	// and up to chunkSize more are read after them.  keepFrom NULL starts a new stream.
+	// Returns the start of the buffer - anything pointing into the old buffer is invalid.
+	const char* readNextChunk(istream& input, const char* keepFrom, size_t chunkSize);
+
 	const char* end();
+
+	// Drop the data, but keep an allocated buffer for the next readInFile(istream&) or readNextChunk.
+	void release();
+
+	const char* start() { return buffer; }
+
+	// at is in the data - end() counts as in the data, for the endOfInput token.
+	bool contains(const char* at) { return NULL != buffer && buffer <= at && at <= end(); }
+
+	// Find all the line starts.  positionOf builds this if it has to, call it first to share the ReadFileData between threads.
+	void buildLineIndex();
+
+	// The line and character at "at" - the same numbers the tokenizer gives a token starting there.
+	void positionOf(const char* at, long& lineNumber, long& characterNumber);
+
+	// Check the data is utf8, and find the runs of non-ASCII bytes.  Only the first call does anything - it skips
+	// the ASCII with scanKernels->skipAscii, and only decodes the runs.  Not thread safe, like buildLineIndex.
+	void checkUtf8();
+
+	// The start offset of each bad utf8 sequence (a stray continuation byte, an overlong or cut off sequence,
+	// a surrogate, past U+10FFFF), and the non-ASCII runs.  Both are empty for ASCII.  checkUtf8 first.
+	const vector<size_t>& badUtf8() const { return badUtf8Offsets; }
+	const vector<NonAsciiRun>& nonAscii() const { return nonAsciiRuns; }
+
+	// The extra bytes (see NonAsciiRun) from "from" up to "to" - the bytes that are not characters of their own.
+	size_t extraBytesBetween(size_t from, size_t to);
+
+	// characterNumber counts bytes - the same column in characters (code points).  A bad byte is one character.
+	long codePointColumn(const char* at, long characterNumber);
+
+	// The length of the good utf8 sequence at "at" (a byte with 0x80 set), 0 if it is bad.
+	static size_t utf8SequenceLength(const unsigned char* at, const unsigned char* end);
 };
 
 #endif // READFILEDATA_H_INCLUDED
@@ -2,11 +2,184 @@
 #define SHADOW_PROMISES_TOKENIZER_H_INCLUDED
 
 #include "Tokenizer.h"
+#include "GrammarScanning.h"
+#include "KeywordTable.h"
 
+// The MatchInfo.id to typeFlags conversion for Shadow Promises
+constexpr long shadowPromisesTypeFromId(char id)
+{
+    switch (id)
+    {
+    case '"':
+    case '\'':
+        return Token::stringValue;
+    case '1':
+        return Token::number;
+    case 'x':
+        return Token::hexNumber;
+    case '/':
+        return Token::comment;
+    case '*':
+        return Token::multiLineComment;
+    case 'a':
+        return Token::identifier;
+    case ':':
+        return Token::identifier | Token::packageName;
+    case '.':
+        return Token::member;
+    case '{':
+        return Token::block_start;
+    case '}':
+        return Token::block_end;
+    case '(':
+        return Token::params_start;
+    case ')':
+        return Token::params_end;
+    case '[':
+        return Token::prototype_start;
+    case ']':
+        return Token::prototype_end;
+    case '@':
+        return Token::assignment;
+    }
+
+    return Token::incomplete;
+}
+
+// The core namespace words, each with an id of its own in Token::keywordId.  The parser can switch on the id
+// instead of comparing the text.  Every other :name is an identifier in a package.
+enum ShadowPromisesKeyword : uint16_t
+{
+    notAKeyword = 0,
+
+    keywordIf,
+    keywordThen,
+    keywordElse,
+    keywordLoop,
+    keywordLoopExit,
+    keywordNext,
+    keywordBreak,
+    keywordExit,
+    keywordTest,
+    keywordReturn,
+    keywordSelf,
+    keywordAnd,
+    keywordOr,
+    keywordNand,
+    keywordNot,
+    keywordFunction,
+    keywordFuncSpec,
+    keywordScratch,
+    keywordImport,
+    keywordStartAsync,
+    keywordContinueWith,
+    keywordContinueIf,
+
+    // The call types
+    keywordInline,
+    keywordAsync,
+    keywordThread,
+    keywordRemote,
+    keywordUiThread,
+
+    // Conditional compilation - these are Token::compilerFlag
+    keywordOption,
+    keywordOpt,
+    keywordDefine,
+    keywordUndefine,
+};
+
+constexpr KeywordTable<31> shadowPromisesKeywords({ {
+    { ":if"sv,              Token::keyword,         keywordIf },
+    { ":then"sv,            Token::keyword,         keywordThen },
+    { ":else"sv,            Token::keyword,         keywordElse },
+    { ":loop"sv,            Token::keyword,         keywordLoop },
+    { ":loopExit"sv,        Token::keyword,         keywordLoopExit },
+    { ":next"sv,            Token::keyword,         keywordNext },
+    { ":break"sv,           Token::keyword,         keywordBreak },
+    { ":exit"sv,            Token::keyword,         keywordExit },
+    { ":test"sv,            Token::keyword,         keywordTest },
+    { ":return"sv,          Token::functionReturn,  keywordReturn },
+    { ":self"sv,            Token::selfCall,        keywordSelf },
+    { ":and"sv,             Token::keyword,         keywordAnd },
+    { ":or"sv,              Token::keyword,         keywordOr },
+    { ":nand"sv,            Token::keyword,         keywordNand },
+    { ":not"sv,             Token::keyword,         keywordNot },
+    { ":function"sv,        Token::keyword,         keywordFunction },
+    { ":funcSpec"sv,        Token::keyword,         keywordFuncSpec },
+    { ":scratch"sv,         Token::keyword,         keywordScratch },
+    { ":import"sv,          Token::keyword,         keywordImport },
+    { ":startAsync"sv,      Token::keyword,         keywordStartAsync },
+    { ":continueWith"sv,    Token::keyword,         keywordContinueWith },
+    { ":continueIf"sv,      Token::keyword,         keywordContinueIf },
+    { ":inline"sv,          Token::keyword,         keywordInline },
+    { ":async"sv,           Token::keyword,         keywordAsync },
+    { ":thread"sv,          Token::keyword,         keywordThread },
+    { ":remote"sv,          Token::keyword,         keywordRemote },
+    { ":uiThread"sv,        Token::keyword,         keywordUiThread },
+    { ":option"sv,          Token::compilerFlag,    keywordOption },
+    { ":opt"sv,             Token::compilerFlag,    keywordOpt },
+    { ":define"sv,          Token::compilerFlag,    keywordDefine },
+    { ":undefine"sv,        Token::compilerFlag,    keywordUndefine },
+} });
+
+// Type a : identifier that is a core word, and stamp it with the keyword id.
+inline void typeShadowPromisesKeyword(Token& token)
+{
+    const KeywordType* keyword = shadowPromisesKeywords.lookup(token.tokenString);
+    if (NULL != keyword)
+    {
+        token.typeFlags = keyword->typeFlags;
+        token.keywordId = keyword->id;
+    }
+}
+
+using ShadowPromisesRules = StaticGrammar<
+    shadowPromisesTypeFromId,
+    GrammarRule<' ', WhiteSpaceMatcher>,
+    GrammarRule<'"', StartEndMatcher, '"'>,
+    GrammarRule<'\'', StartEndMatcher, '\''>,
+    GrammarRule<'0', NuberMatcher>,
+    GrammarRule<'-', NuberMatcher>,
+    GrammarRule<'/', LineCommentMatcher, '/'>,
+    GrammarRule<'*', StartEndMatcher, '*'>,
+    GrammarRule<'a', IdentifierMatcher, ':'>,
+    SingleCharacterRule<'.'>,
+    SingleCharacterRule<'{'>,
+    SingleCharacterRule<'}'>,
+    SingleCharacterRule<'('>,
+    SingleCharacterRule<')'>,
+    SingleCharacterRule<'['>,
+    SingleCharacterRule<']'>,
+    SingleCharacterRule<'@'>
+>;
+
+// The Shadow Promises grammar compiled into a single scanning loop.  initShadowPromisesTokenizer() uses it.
+// The rules, plus the keyword lookup for the : identifiers.
+class ShadowPromisesGrammar : public ShadowPromisesRules
+{
+public:
+    ShadowPromisesGrammar(Tokenizer& tokenizer) : ShadowPromisesRules(tokenizer) {}
+
+    void setTokenType(const MatchInfo& info, Token& token) const
+    {
+        ShadowPromisesRules::setTokenType(info, token);
+        if (':' == info.id) typeShadowPromisesKeyword(token);
+    }
+};
+
+void shadowPromisesIdToTokenType(const MatchInfo& info, Token& token);
+
+// The Shadow Promises grammar, built on first use.  Every Tokenizer from initShadowPromisesTokenizer shares it.
+extern "C++" EXPORT const shared_ptr<const TokenizerGrammar>& shadowPromisesTokenizerGrammar();
+
+// A new Tokenizer for Shadow Promises - one per thread, they can all tokenize at once.
 extern "C++" EXPORT Tokenizer& initShadowPromisesTokenizer();
 
+// The human TokenDumper text.  firstTokenIndex is the TokenIndex of tokens[0] - for dumping the chunks from tokenizeStream.
 extern "C" EXPORT void dumpTokens(
     std::ostream& output, 
-    token_vector tokens);
+    const token_vector& tokens,
+    int firstTokenIndex = 0);
 
 #endif //SHADOW_PROMISES_TOKENIZER_H_INCLUDED
\ No newline at end of file
@@ -0,0 +1,490 @@
+#include "pch.h"
+#include "SimdScanning.h"
+
+#include <bit>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#   define SP_X86_KERNELS
+#   include <immintrin.h>
+#   ifdef _MSC_VER
+#       include <intrin.h>
+#       define SP_TARGET_SSE2
+#       define SP_TARGET_AVX2
+#   else
+#       define SP_TARGET_SSE2 __attribute__((target("sse2")))
+#       define SP_TARGET_AVX2 __attribute__((target("avx2")))
+#   endif
+#endif
+
+using namespace std;
+
+// The '\n' bits (one per byte) found in a block starting at blockStart.
+static inline void addNewlines(unsigned int newlineBits, const char* blockStart, long& lines, const char*& lastNewline)
+{
+    if (0 != newlineBits)
+    {
+        lines += popcount(newlineBits);
+        lastNewline = blockStart + (bit_width(newlineBits) - 1);
+    }
+}
+
+// Just the bits before the first set bit of stopBits.
+static inline unsigned int bitsBefore(unsigned int bits, unsigned int stopBits)
+{
+    return bits & ((1u << countr_zero(stopBits)) - 1);
+}
+
+//-----------------------------------------------------------------------------
+// Scalar - always available, and used for the tails of the vector kernels.
+//-----------------------------------------------------------------------------
+static const char* scalarSkipWhitespace(const char* pos, const char* end, long& lines, const char*& lastNewline)
+{
+    while (pos < end && isSpaceChar(*pos))
+    {
+        if ('\n' == *pos)
+        {
+            lines++;
+            lastNewline = pos;
+        }
+        pos++;
+    }
+    return pos;
+}
+
+static inline bool isIdentifierChar(char c)
+{
+    return '_' == c || isCharacterClass(c, charMultiByte) ||
+        (isCharacterClass(c, charPrintable) && !isCharacterClass(c, charPunctuation | charSpace));
+}
+
+static const char* scalarSkipIdentifier(const char* pos, const char* end)
+{
+    while (pos < end && isIdentifierChar(*pos)) pos++;
+    return pos;
+}
+
+static const char* scalarScanToEither(const char* pos, const char* end, char first, char second, long& lines, const char*& lastNewline)
+{
+    while (pos < end && first != *pos && second != *pos)
+    {
+        if ('\n' == *pos)
+        {
+            lines++;
+            lastNewline = pos;
+        }
+        pos++;
+    }
+    return pos;
+}
+
+static const char* scalarFindCharacter(const char* pos, const char* end, char toFind)
+{
+    const void* found = (pos < end) ? memchr(pos, toFind, end - pos) : NULL;
+    return (NULL != found) ? (const char*)found : end;
+}
+
+static size_t scalarCountNewlines(const char* pos, const char* end, const char*& lastNewline)
+{
+    size_t count = 0;
+    for (; pos < end; pos++)
+    {
+        if ('\n' == *pos)
+        {
+            count++;
+            lastNewline = pos;
+        }
+    }
+    return count;
+}
+
+static const char* scalarSkipAscii(const char* pos, const char* end)
+{
+    // 8 bytes at a time - the high bits of all of them in one test
+    for (; pos + 8 <= end; pos += 8)
+    {
+        uint64_t word;
+        memcpy(&word, pos, sizeof(word));
+        if (0 != (word & 0x8080808080808080ull)) break;
+    }
+
+    while (pos < end && 0 == (0x80 & *pos)) pos++;
+    return pos;
+}
+
+static const ScanningKernels scalarKernels = {
+    ScanningKernels::scalar,
+    "scalar",
+    scalarSkipWhitespace,
+    scalarSkipIdentifier,
+    scalarScanToEither,
+    scalarFindCharacter,
+    scalarCountNewlines,
+    scalarSkipAscii,
+};
+
+#ifdef SP_X86_KERNELS
+//-----------------------------------------------------------------------------
+// SSE2 - 16 bytes per step
+//-----------------------------------------------------------------------------
+SP_TARGET_SSE2 static const char* sse2SkipWhitespace(const char* pos, const char* end, long& lines, const char*& lastNewline)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i belowTab = _mm_set1_epi8('\t' - 1);
+    const __m128i aboveReturn = _mm_set1_epi8('\r' + 1);
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    while (pos + 16 <= end)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)pos);
+
+        // ' ' or '\t' .. '\r'  (bytes with 0x80 set are negative, so they are never in the range)
+        __m128i isSpace = _mm_or_si128(_mm_cmpeq_epi8(block, space),
+            _mm_and_si128(_mm_cmpgt_epi8(block, belowTab), _mm_cmplt_epi8(block, aboveReturn)));
+
+        unsigned int notSpaceBits = ~(unsigned int)_mm_movemask_epi8(isSpace) & 0xFFFF;
+        unsigned int newlineBits = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+
+        if (0 != notSpaceBits)
+        {
+            addNewlines(bitsBefore(newlineBits, notSpaceBits), pos, lines, lastNewline);
+            return pos + countr_zero(notSpaceBits);
+        }
+
+        addNewlines(newlineBits, pos, lines, lastNewline);
+        pos += 16;
+    }
+
+    return scalarSkipWhitespace(pos, end, lines, lastNewline);
+}
+
+SP_TARGET_SSE2 static const char* sse2SkipIdentifier(const char* pos, const char* end)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i belowZero = _mm_set1_epi8('0' - 1);
+    const __m128i aboveNine = _mm_set1_epi8('9' + 1);
+    const __m128i lowerCase = _mm_set1_epi8(0x20);
+    const __m128i belowA = _mm_set1_epi8('a' - 1);
+    const __m128i aboveZ = _mm_set1_epi8('z' + 1);
+    const __m128i underscore = _mm_set1_epi8('_');
+
+    while (pos + 16 <= end)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)pos);
+        __m128i lower = _mm_or_si128(block, lowerCase);
+
+        __m128i isIdentifier = _mm_or_si128(
+            _mm_or_si128(_mm_cmplt_epi8(block, zero), _mm_cmpeq_epi8(block, underscore)),
+            _mm_or_si128(
+                _mm_and_si128(_mm_cmpgt_epi8(block, belowZero), _mm_cmplt_epi8(block, aboveNine)),
+                _mm_and_si128(_mm_cmpgt_epi8(lower, belowA), _mm_cmplt_epi8(lower, aboveZ))));
+
+        unsigned int stopBits = ~(unsigned int)_mm_movemask_epi8(isIdentifier) & 0xFFFF;
+        if (0 != stopBits) return pos + countr_zero(stopBits);
+
+        pos += 16;
+    }
+
+    return scalarSkipIdentifier(pos, end);
+}
+
+SP_TARGET_SSE2 static const char* sse2ScanToEither(const char* pos, const char* end, char first, char second, long& lines, const char*& lastNewline)
+{
+    const __m128i firstChar = _mm_set1_epi8(first);
+    const __m128i secondChar = _mm_set1_epi8(second);
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    while (pos + 16 <= end)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)pos);
+
+        unsigned int stopBits = (unsigned int)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(block, firstChar), _mm_cmpeq_epi8(block, secondChar)));
+        unsigned int newlineBits = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+
+        if (0 != stopBits)
+        {
+            addNewlines(bitsBefore(newlineBits, stopBits), pos, lines, lastNewline);
+            return pos + countr_zero(stopBits);
+        }
+
+        addNewlines(newlineBits, pos, lines, lastNewline);
+        pos += 16;
+    }
+
+    return scalarScanToEither(pos, end, first, second, lines, lastNewline);
+}
+
+SP_TARGET_SSE2 static const char* sse2FindCharacter(const char* pos, const char* end, char toFind)
+{
+    const __m128i findChar = _mm_set1_epi8(toFind);
+
+    while (pos + 16 <= end)
+    {
+        unsigned int foundBits = (unsigned int)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)pos), findChar));
+        if (0 != foundBits) return pos + countr_zero(foundBits);
+
+        pos += 16;
+    }
+
+    return scalarFindCharacter(pos, end, toFind);
+}
+
+SP_TARGET_SSE2 static size_t sse2CountNewlines(const char* pos, const char* end, const char*& lastNewline)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    long count = 0;
+
+    while (pos + 16 <= end)
+    {
+        unsigned int newlineBits = (unsigned int)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)pos), newline));
+        addNewlines(newlineBits, pos, count, lastNewline);
+
+        pos += 16;
+    }
+
+    return count + scalarCountNewlines(pos, end, lastNewline);
+}
+
+SP_TARGET_SSE2 static const char* sse2SkipAscii(const char* pos, const char* end)
+{
+    // The high bit of each byte is the movemask bit, no compare needed
+    while (pos + 16 <= end)
+    {
+        unsigned int highBits = (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)pos));
+        if (0 != highBits) return pos + countr_zero(highBits);
+
+        pos += 16;
+    }
+
+    return scalarSkipAscii(pos, end);
+}
+
+static const ScanningKernels sse2Kernels = {
+    ScanningKernels::sse2,
+    "sse2",
+    sse2SkipWhitespace,
+    sse2SkipIdentifier,
+    sse2ScanToEither,
+    sse2FindCharacter,
+    sse2CountNewlines,
+    sse2SkipAscii,
+};
+
+//-----------------------------------------------------------------------------
+// AVX2 - 32 bytes per step
+//-----------------------------------------------------------------------------
+SP_TARGET_AVX2 static const char* avx2SkipWhitespace(const char* pos, const char* end, long& lines, const char*& lastNewline)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i belowTab = _mm256_set1_epi8('\t' - 1);
+    const __m256i aboveReturn = _mm256_set1_epi8('\r' + 1);
+    const __m256i newline = _mm256_set1_epi8('\n');
+
+    while (pos + 32 <= end)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i*)pos);
+
+        __m256i isSpace = _mm256_or_si256(_mm256_cmpeq_epi8(block, space),
+            _mm256_and_si256(_mm256_cmpgt_epi8(block, belowTab), _mm256_cmpgt_epi8(aboveReturn, block)));
+
+        unsigned int notSpaceBits = ~(unsigned int)_mm256_movemask_epi8(isSpace);
+        unsigned int newlineBits = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+
+        if (0 != notSpaceBits)
+        {
+            addNewlines(bitsBefore(newlineBits, notSpaceBits), pos, lines, lastNewline);
+            return pos + countr_zero(notSpaceBits);
+        }
+
+        addNewlines(newlineBits, pos, lines, lastNewline);
+        pos += 32;
+    }
+
+    return sse2SkipWhitespace(pos, end, lines, lastNewline);
+}
+
+SP_TARGET_AVX2 static const char* avx2SkipIdentifier(const char* pos, const char* end)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i belowZero = _mm256_set1_epi8('0' - 1);
+    const __m256i aboveNine = _mm256_set1_epi8('9' + 1);
+    const __m256i lowerCase = _mm256_set1_epi8(0x20);
+    const __m256i belowA = _mm256_set1_epi8('a' - 1);
+    const __m256i aboveZ = _mm256_set1_epi8('z' + 1);
+    const __m256i underscore = _mm256_set1_epi8('_');
+
+    while (pos + 32 <= end)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i*)pos);
+        __m256i lower = _mm256_or_si256(block, lowerCase);
+
+        __m256i isIdentifier = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi8(zero, block), _mm256_cmpeq_epi8(block, underscore)),
+            _mm256_or_si256(
+                _mm256_and_si256(_mm256_cmpgt_epi8(block, belowZero), _mm256_cmpgt_epi8(aboveNine, block)),
+                _mm256_and_si256(_mm256_cmpgt_epi8(lower, belowA), _mm256_cmpgt_epi8(aboveZ, lower))));
+
+        unsigned int stopBits = ~(unsigned int)_mm256_movemask_epi8(isIdentifier);
+        if (0 != stopBits) return pos + countr_zero(stopBits);
+
+        pos += 32;
+    }
+
+    return sse2SkipIdentifier(pos, end);
+}
+
+SP_TARGET_AVX2 static const char* avx2ScanToEither(const char* pos, const char* end, char first, char second, long& lines, const char*& lastNewline)
+{
+    const __m256i firstChar = _mm256_set1_epi8(first);
+    const __m256i secondChar = _mm256_set1_epi8(second);
+    const __m256i newline = _mm256_set1_epi8('\n');
+
+    while (pos + 32 <= end)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i*)pos);
+
+        unsigned int stopBits = (unsigned int)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, firstChar), _mm256_cmpeq_epi8(block, secondChar)));
+        unsigned int newlineBits = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+
+        if (0 != stopBits)
+        {
+            addNewlines(bitsBefore(newlineBits, stopBits), pos, lines, lastNewline);
+            return pos + countr_zero(stopBits);
+        }
+
+        addNewlines(newlineBits, pos, lines, lastNewline);
+        pos += 32;
+    }
+
+    return sse2ScanToEither(pos, end, first, second, lines, lastNewline);
+}
+
+SP_TARGET_AVX2 static const char* avx2FindCharacter(const char* pos, const char* end, char toFind)
+{
+    const __m256i findChar = _mm256_set1_epi8(toFind);
+
+    while (pos + 32 <= end)
+    {
+        unsigned int foundBits = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)pos), findChar));
+        if (0 != foundBits) return pos + countr_zero(foundBits);
+
+        pos += 32;
+    }
+
+    return sse2FindCharacter(pos, end, toFind);
+}
+
+SP_TARGET_AVX2 static size_t avx2CountNewlines(const char* pos, const char* end, const char*& lastNewline)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    long count = 0;
+
+    while (pos + 32 <= end)
+    {
+        unsigned int newlineBits = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)pos), newline));
+        addNewlines(newlineBits, pos, count, lastNewline);
+
+        pos += 32;
+    }
+
+    return count + sse2CountNewlines(pos, end, lastNewline);
+}
+
+SP_TARGET_AVX2 static const char* avx2SkipAscii(const char* pos, const char* end)
+{
+    // 64 bytes per step while it is all ASCII - one test for both halves
+    while (pos + 64 <= end)
+    {
+        __m256i first = _mm256_loadu_si256((const __m256i*)pos);
+        __m256i second = _mm256_loadu_si256((const __m256i*)(pos + 32));
+        if (0 != _mm256_movemask_epi8(_mm256_or_si256(first, second))) break;
+
+        pos += 64;
+    }
+
+    while (pos + 32 <= end)
+    {
+        unsigned int highBits = (unsigned int)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)pos));
+        if (0 != highBits) return pos + countr_zero(highBits);
+
+        pos += 32;
+    }
+
+    return sse2SkipAscii(pos, end);
+}
+
+static const ScanningKernels avx2Kernels = {
+    ScanningKernels::avx2,
+    "avx2",
+    avx2SkipWhitespace,
+    avx2SkipIdentifier,
+    avx2ScanToEither,
+    avx2FindCharacter,
+    avx2CountNewlines,
+    avx2SkipAscii,
+};
+#endif // SP_X86_KERNELS
+
+
+EXPORT ScanningKernels::Level supportedScanningLevel()
+{
+    ScanningKernels::Level supported = ScanningKernels::scalar;
+
+#ifdef SP_X86_KERNELS
+#   ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    if (info[3] & (1 << 26)) supported = ScanningKernels::sse2;
+
+    // AVX2 needs the OS to save the ymm registers (OSXSAVE and XCR0 bits 1, 2) as well as the cpuid bit.
+    bool osSavesYmm = (info[2] & (1 << 27)) && (6 == (_xgetbv(0) & 6));
+    if (osSavesYmm && 7 <= maxLeaf)
+    {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5)) supported = ScanningKernels::avx2;
+    }
+#   else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) supported = ScanningKernels::sse2;
+    if (__builtin_cpu_supports("avx2")) supported = ScanningKernels::avx2;
+#   endif
+#endif
+
+    return supported;
+}
+
+EXPORT ScanningKernels::Level selectScanningKernels(ScanningKernels::Level level)
+{
+    ScanningKernels::Level supported = supportedScanningLevel();
+    if (level > supported) level = supported;
+
+    switch (level)
+    {
+#ifdef SP_X86_KERNELS
+    case ScanningKernels::avx2:
+        scanKernels = &avx2Kernels;
+        break;
+    case ScanningKernels::sse2:
+        scanKernels = &sse2Kernels;
+        break;
+#endif
+    default:
+        scanKernels = &scalarKernels;
+        break;
+    }
+
+    return scanKernels->level;
+}
+
+// Start with scalar, so anything that runs during static initialization is safe, then pick the best.
+EXPORT const ScanningKernels* scanKernels = &scalarKernels;
+static ScanningKernels::Level initialKernelLevel = selectScanningKernels();
@@ -0,0 +1,48 @@
+#pragma once
+
+// Bulk scanning kernels for the TokenScanning matchers.
+//
+// Each kernel has a scalar, SSE2 and AVX2 version.  The best version for the running CPU is
+// picked once (see selectScanningKernels) and the matchers call through scanKernels.
+// All the kernels stop at end, and only do full vector loads that fit before end.
+
+struct ScanningKernels
+{
+    enum Level
+    {
+        scalar,
+        sse2,
+        avx2,
+
+        best = 16,  // Whatever the CPU supports
+    };
+
+    Level   level;
+    const char* name;
+
+    // Skip isspace characters.  lines counts the '\n', lastNewline is updated to the last '\n' passed.
+    const char* (*skipWhitespace)(const char* pos, const char* end, long& lines, const char*& lastNewline);
+
+    // Skip identifier characters: letters, digits, '_' and any byte with 0x80 set.
+    const char* (*skipIdentifier)(const char* pos, const char* end);
+
+    // Find the first "first" or "second" character.  The '\n' passed over are counted like skipWhitespace.
+    const char* (*scanToEither)(const char* pos, const char* end, char first, char second, long& lines, const char*& lastNewline);
+
+    // Find the first toFind character, or end.
+    const char* (*findCharacter)(const char* pos, const char* end, char toFind);
+
+    // Count all the '\n' from pos to end.
+    size_t (*countNewlines)(const char* pos, const char* end, const char*& lastNewline);
+
+    // Find the first byte with 0x80 set (not ASCII), or end.
+    const char* (*skipAscii)(const char* pos, const char* end);
+};
+
+extern EXPORT const ScanningKernels* scanKernels;
+
+// Select the kernels the matchers use.  Returns the level actually selected - asking for a level the CPU
+// does not support falls back to the best supported level.
+EXPORT ScanningKernels::Level selectScanningKernels(ScanningKernels::Level level = ScanningKernels::best);
+
+EXPORT ScanningKernels::Level supportedScanningLevel();
@@ -0,0 +1,158 @@
+#include "pch.h"
+#include "StringLiterals.h"
+#include "SimdScanning.h"
+
+#include <cstring>
+
+// The hex digits of a {hex} escape.  runner is at the {, and is left after the }.
+static bool readBracedHex(const char*& runner, const char* end, uint32_t& value)
+{
+    const char* digit = runner + 1;
+    value = 0;
+
+    int digitCount = 0;
+    for (; digit < end && isHexDigitChar(*digit); digit++, digitCount++)
+    {
+        if (6 <= digitCount) return false;
+
+        char c = *digit;
+        value = (value << 4) | (uint32_t)(('0' <= c && c <= '9') ? c - '0' : (c | 0x20) - 'a' + 10);
+    }
+
+    if (0 == digitCount || digit >= end || '}' != *digit) return false;
+
+    runner = digit + 1;
+    return true;
+}
+
+static char* appendUtf8(char* out, uint32_t codePoint)
+{
+    if (codePoint < 0x80)
+    {
+        *out++ = (char)codePoint;
+    }
+    else if (codePoint < 0x800)
+    {
+        *out++ = (char)(0xC0 | (codePoint >> 6));
+        *out++ = (char)(0x80 | (codePoint & 0x3F));
+    }
+    else if (codePoint < 0x10000)
+    {
+        *out++ = (char)(0xE0 | (codePoint >> 12));
+        *out++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (codePoint & 0x3F));
+    }
+    else
+    {
+        *out++ = (char)(0xF0 | (codePoint >> 18));
+        *out++ = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+        *out++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (codePoint & 0x3F));
+    }
+
+    return out;
+}
+
+bool StringLiterals::decode(string_view literal, char* into, size_t& length)
+{
+    const char* runner = literal.data();
+    const char* end = runner + literal.size();
+    char* out = into;
+    bool good = true;
+
+    while (runner < end)
+    {
+        // Copy up to the next escape in one go
+        const char* escape = scanKernels->findCharacter(runner, end, '\\');
+        memcpy(out, runner, escape - runner);
+        out += escape - runner;
+
+        runner = escape;
+        if (runner == end) break;
+
+        // A \ at the very end - the scanner would have taken it as escaping the quote, so only a hand made literal
+        if (++runner == end)
+        {
+            *out++ = '\\';
+            break;
+        }
+
+        char escaped = *runner++;
+        switch (escaped)
+        {
+        case 'n':   *out++ = '\n'; break;
+        case 'r':   *out++ = '\r'; break;
+        case 't':   *out++ = '\t'; break;
+        case '0':   *out++ = '\0'; break;
+
+        case 'x':
+        case 'u':
+        {
+            // The shortest, \x{h} or \u{h}, is 5 characters for at most 4 bytes - the value never outgrows the literal.
+            uint32_t value;
+            const char* braced = runner;
+            if (runner < end && '{' == *runner && readBracedHex(braced, end, value))
+            {
+                if ('x' == escaped && value <= 0xFF)
+                {
+                    *out++ = (char)value;
+                    runner = braced;
+                    break;
+                }
+                if ('u' == escaped && value <= 0x10FFFF && (value < 0xD800 || 0xDFFF < value))
+                {
+                    out = appendUtf8(out, value);
+                    runner = braced;
+                    break;
+                }
+            }
+
+            // Bad - keep it as it is, the rest is copied as ordinary characters
+            *out++ = '\\';
+            *out++ = escaped;
+            good = false;
+            break;
+        }
+
+        default:
+            *out++ = escaped;
+            break;
+        }
+    }
+
+    length = out - into;
+    return good;
+}
+
+bool StringLiterals::value(const Token& token, string_view& text)
+{
+    text = token.tokenString;
+    if (Token::stringValue != token.typeFlags || text.size() < 2) return true;
+
+    // Inside the quotes
+    text = text.substr(1, text.size() - 2);
+    if (!token.hasEscape) return true;
+
+    auto found = decoded.find(token.tokenString.data());
+    if (decoded.end() != found)
+    {
+        text = found->second.text;
+        return found->second.good;
+    }
+
+    char* into = static_cast<char*>(arena.allocate(text.size(), 1));
+    size_t length;
+    bool good = decode(text, into, length);
+    bytesCopied += length;
+
+    text = string_view(into, length);
+    decoded.emplace(token.tokenString.data(), Decoded{ text, good });
+    return good;
+}
+
+void StringLiterals::clear()
+{
+    decoded.clear();
+    arena.reset();
+    bytesCopied = 0;
+}
@@ -0,0 +1,76 @@
+#ifndef STRING_LITERALS_H_INCLUDED
+#define STRING_LITERALS_H_INCLUDED
+
+#include "Tokenizer.h"
+#include "TokenArena.h"
+
+#include <unordered_map>
+
+/*
+* The values of string tokens, with the \ escapes decoded.
+*
+*   StringLiterals literals;
+*   string_view text = literals.value(token);      // 'a\tb' is a, tab, b
+*
+* The scanner marks the strings that have an escape (Token::hasEscape).  The value of a string without one is
+* the tokenString inside the quotes - nothing is copied.  The others are decoded the first time they are asked
+* for, into the StringLiterals' arena, and the same string_view is given back after that.  The runs between the
+* escapes are found with scanKernels->findCharacter and copied with memcpy, so a long string is mostly bulk copies.
+*
+* The values are found by the address of the tokenString, so clear them before a source buffer is reused for other
+* text.  Tokenizer::stringLiterals does that for the Tokenizer's own sources.
+*
+* The escapes:
+*   \n \r \t \0         newline, return, tab and nul
+*   \x{hh}              the byte hh
+*   \u{hhhhhh}          the code point, as utf8
+*   \ anything else     that character - \\ \" \' and the rest
+* A bad \x or \u (no {, not hex, no }, too big, a surrogate) is kept as it is, and value returns false.
+*
+* The values are good until clear, and the source has to stay as long.  Not thread safe - one per thread.
+*/
+class EXPORT StringLiterals
+{
+protected:
+    struct Decoded
+    {
+        string_view     text;
+        bool            good;
+    };
+
+    TokenArena                                  arena;
+
+    // By the start of the tokenString
+    unordered_map<const char*, Decoded>         decoded;
+
+    size_t                                      bytesCopied;
+
+public:
+    StringLiterals(size_t blockSize = 64 * 1024) : arena(blockSize), bytesCopied(0) {}
+
+    StringLiterals(const StringLiterals&) = delete;
+    StringLiterals& operator=(const StringLiterals&) = delete;
+
+    // The value of a stringValue token.  Other tokens give back their tokenString.
+    // Returns false if the string has a bad escape.
+    bool value(const Token& token, string_view& text);
+
+    string_view value(const Token& token)
+    {
+        string_view text;
+        value(token, text);
+        return text;
+    }
+
+    // Decode the inside of a string literal into "into", which must have room for literal.size() bytes -
+    // the value is never longer.  length is set to the bytes written.  False if there was a bad escape.
+    static bool decode(string_view literal, char* into, size_t& length);
+
+    // Drop all the decoded values, the arena memory is kept for the next ones.
+    void clear();
+
+    // The bytes decoded into the arena, for checking how many strings needed it.
+    size_t copiedBytes() const { return bytesCopied; }
+};
+
+#endif // STRING_LITERALS_H_INCLUDED
@@ -9,8 +9,9 @@
 class FunctionPrototype;
 class StructureType;
 
-class SymbolLocation : vector<int>
+class SymbolLocation : public vector<int>
 {
+public:
     SymbolLocation(const vector<int>& other) : vector<int>(other)
     {
     }
@@ -89,9 +90,25 @@ public:
     FunctionPrototype*  funcType;
     StructureType*      structType;
 
+    // Interned tokens (Tokenizer::atoms) compare their atoms instead of their text.  All the tokens in one
+    // SymbolTable must be interned by the same AtomTable, or none of them interned, to keep the order consistent.
+    bool tokenLess(const Symbol& other) const
+    {
+        if (AtomTable::noAtom != token.atom && AtomTable::noAtom != other.token.atom) return token.atom < other.token.atom;
+
+        return token.tokenString < other.token.tokenString;
+    }
+
+    bool tokenMatches(const Symbol& other) const
+    {
+        if (AtomTable::noAtom != token.atom && AtomTable::noAtom != other.token.atom) return token.atom == other.token.atom;
+
+        return (token.tokenString == other.token.tokenString);
+    }
+
     bool operator < (const Symbol& other) const
     {
-        if (token.tokenString < other.token.tokenString)  return true;
+        if (tokenLess(other))  return true;
         if (pareseLocation < other.pareseLocation) return true;
 
         return false;
@@ -99,15 +116,10 @@ public:
 
     bool operator == (const Symbol& other) const
     {
-        return (token.tokenString == other.token.tokenString) &&
+        return tokenMatches(other) &&
             (pareseLocation == other.pareseLocation);
     }
 
-    bool tokenMatches(const Symbol& other) const
-    {
-        return (token.tokenString == other.token.tokenString);
-    }
-
     bool parseLoactionStartsWith(vector<int>& otherPareseLocation) const
     {
         bool matches = true;
@@ -124,7 +136,7 @@ public:
     {
         // tokenString must be the same and pareseLocation must match the start of other.pareseLocation
         // Matching the start finds the definition form a potentially higher block
-        return (token.tokenString == other.token.tokenString) &&
+        return tokenMatches(other) &&
             parseLoactionStartsWith(other.pareseLocation);
     }
 
@@ -207,7 +219,7 @@ public:
 
     vector<int>& GetLocationRef()
     {
-        vector<int>* locationPtr;
+        SymbolLocation* locationPtr;
         if (locationChanged)
         {
             locationPtr = new SymbolLocation(currentLocation);
@@ -0,0 +1,89 @@
+#include "pch.h"
+#include "TokenArena.h"
+
+TokenArena::TokenArena(size_t inBlockSize) :
+    blockSize(inBlockSize),
+    firstBlock(NULL),
+    currentBlock(NULL),
+    cleanups(NULL)
+{
+}
+
+TokenArena::~TokenArena()
+{
+    reset();
+
+    while (NULL != firstBlock)
+    {
+        Block* next = firstBlock->next;
+        ::operator delete(firstBlock);
+        firstBlock = next;
+    }
+}
+
+TokenArena::Block* TokenArena::nextBlock(size_t bytes)
+{
+    Block* next = (NULL != currentBlock) ? currentBlock->next : firstBlock;
+    if (NULL == next || next->size < bytes)
+    {
+        // A new block goes after the current one, any kept blocks after that are still used later.
+        size_t size = max(blockSize, bytes);
+        Block* block = static_cast<Block*>(::operator new(sizeof(Block) + size));
+        block->size = size;
+        block->next = next;
+
+        if (NULL != currentBlock) currentBlock->next = block;
+        else firstBlock = block;
+
+        next = block;
+    }
+
+    next->used = 0;
+    return next;
+}
+
+// at rounded up to alignment
+static char* alignUp(char* at, size_t alignment)
+{
+    return reinterpret_cast<char*>(((uintptr_t)at + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+void* TokenArena::allocate(size_t bytes, size_t alignment)
+{
+    if (NULL != currentBlock)
+    {
+        char* at = alignUp(currentBlock->data() + currentBlock->used, alignment);
+        if (at + bytes <= currentBlock->data() + currentBlock->size)
+        {
+            currentBlock->used = at + bytes - currentBlock->data();
+            return at;
+        }
+    }
+
+    currentBlock = nextBlock(bytes + alignment - 1);
+
+    char* at = alignUp(currentBlock->data(), alignment);
+    currentBlock->used = at + bytes - currentBlock->data();
+    return at;
+}
+
+void TokenArena::reset()
+{
+    while (NULL != cleanups)
+    {
+        Cleanup* cleanup = cleanups;
+        cleanups = cleanup->next;
+        (*cleanup->destroy)(cleanup->object);
+    }
+
+    // Start over in the first block - nextBlock resets each kept block as it gets to it.
+    currentBlock = firstBlock;
+    if (NULL != currentBlock) currentBlock->used = 0;
+}
+
+size_t TokenArena::bytesReserved() const
+{
+    size_t bytes = 0;
+    for (Block* block = firstBlock; NULL != block; block = block->next) bytes += block->size;
+    return bytes;
+}
@@ -0,0 +1,84 @@
+#ifndef TOKEN_ARENA_H_INCLUDED
+#define TOKEN_ARENA_H_INCLUDED
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+* A bump allocator for the objects a Tokenizer makes for each tokenize - the ReadFileData for each source.
+*
+* Memory comes from blocks that are kept until the arena is destroyed.  reset() runs the destructors of the
+* objects made with create (newest first) and starts over at the first block, so after the first few requests
+* a Tokenizer stops going to the heap for them.  Nothing is freed one at a time.
+*
+* Not thread safe - make everything on one thread, the objects can be used from any thread.
+*/
+class EXPORT TokenArena
+{
+protected:
+    struct Block
+    {
+        Block*  next;
+        size_t  size;       // bytes after the Block header
+        size_t  used;
+
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+    };
+
+    // The destructor to run for an object on reset
+    struct Cleanup
+    {
+        Cleanup*    next;
+        void        (*destroy)(void* object);
+        void*       object;
+    };
+
+    size_t      blockSize;
+    Block*      firstBlock;
+    Block*      currentBlock;
+    Cleanup*    cleanups;
+
+    // A block of at least bytes after currentBlock - the next kept block if it is big enough.
+    Block* nextBlock(size_t bytes);
+
+    template <class T>
+    static void destroyObject(void* object) { static_cast<T*>(object)->~T(); }
+
+public:
+    TokenArena(size_t inBlockSize = 64 * 1024);
+    ~TokenArena();
+
+    TokenArena(const TokenArena&) = delete;
+    TokenArena& operator=(const TokenArena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    // Make a T in the arena.  Its destructor is run by reset, or when the arena is destroyed.
+    template <class T, class... Args>
+    T* create(Args&&... args)
+    {
+        void* memory = allocate(sizeof(T), alignof(T));
+        T* object = new (memory) T(std::forward<Args>(args)...);
+
+        if constexpr (!std::is_trivially_destructible_v<T>)
+        {
+            Cleanup* cleanup = static_cast<Cleanup*>(allocate(sizeof(Cleanup), alignof(Cleanup)));
+            cleanup->next = cleanups;
+            cleanup->destroy = &destroyObject<T>;
+            cleanup->object = object;
+            cleanups = cleanup;
+        }
+
+        return object;
+    }
+
+    // Destroy everything made with create, and reuse the blocks.
+    void reset();
+
+    // The bytes held in blocks, used or not.
+    size_t bytesReserved() const;
+};
+
+#endif // TOKEN_ARENA_H_INCLUDED
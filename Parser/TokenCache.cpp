@@ -0,0 +1,235 @@
+#include "pch.h"
+#include "TokenCache.h"
+
+#include <cstring>
+#include <fstream>
+
+bool TokenCacheFile::open(const boost::filesystem::path& cachePath, string_view source, uint64_t contentHash, uint64_t checkHash, uint64_t grammarKey)
+{
+    close();
+
+    boost::system::error_code error;
+    if (!boost::filesystem::is_regular_file(cachePath, error)) return false;
+
+    try
+    {
+        mappedFile.open(cachePath);
+    }
+    catch (exception&)
+    {
+        return false;
+    }
+    if (!mappedFile.is_open() || mappedFile.size() < sizeof(TokenCacheHeader)) return false;
+
+    auto fileHeader = reinterpret_cast<const TokenCacheHeader*>(mappedFile.data());
+    auto fileRecords = reinterpret_cast<const TokenCacheRecord*>(mappedFile.data() + sizeof(TokenCacheHeader));
+
+    bool matches =
+        TokenCacheHeader::magic == fileHeader->fileMagic &&
+        TokenCacheHeader::currentVersion == fileHeader->version &&
+        sizeof(TokenCacheRecord) == fileHeader->recordSize &&
+        grammarKey == fileHeader->grammarKey &&
+        contentHash == fileHeader->contentHash &&
+        checkHash == fileHeader->checkHash &&
+        source.size() == fileHeader->sourceSize &&
+        (mappedFile.size() - sizeof(TokenCacheHeader)) / sizeof(TokenCacheRecord) == fileHeader->tokenCount;
+
+    // Every token has to be in the source - a bad file must not give tokenStrings outside of it.
+    for (uint64_t i = 0; matches && i < fileHeader->tokenCount; i++)
+    {
+        matches = (uint64_t)fileRecords[i].offset + fileRecords[i].length <= source.size();
+    }
+
+    if (!matches)
+    {
+        mappedFile.close();
+        return false;
+    }
+
+    header = fileHeader;
+    records = fileRecords;
+    return true;
+}
+
+void TokenCacheFile::close()
+{
+    if (mappedFile.is_open()) mappedFile.close();
+    header = NULL;
+    records = NULL;
+}
+
+Token TokenCacheFile::token(size_t index, string_view source) const
+{
+    const TokenCacheRecord& from = records[index];
+
+    Token token(from.startingLine, from.startingCharacter);
+    from.getToken(token);
+    token.tokenString = source.substr(from.offset, from.length);
+    return token;
+}
+
+void TokenCacheFile::appendTo(token_vector& target, string_view source) const
+{
+    size_t count = size();
+    target.reserve(target.size() + count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const TokenCacheRecord& from = records[i];
+
+        Token& token = target.emplace_back(from.startingLine, from.startingCharacter);
+        from.getToken(token);
+        token.tokenString = string_view(source.data() + from.offset, from.length);
+    }
+}
+
+
+TokenCache::TokenCache(boost::filesystem::path inDirectory, uint64_t inGrammarKey) :
+    directory(std::move(inDirectory)),
+    grammarKey(inGrammarKey),
+    writeCount(0)
+{
+    boost::system::error_code error;
+    boost::filesystem::create_directories(directory, error);
+}
+
+static inline uint64_t rotateLeft(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t readWord(const char* at)
+{
+    uint64_t word;
+    memcpy(&word, at, sizeof(word));
+    return word;
+}
+
+static const uint64_t hashPrime1 = 0x9E3779B185EBCA87ull;
+static const uint64_t hashPrime2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t hashPrime3 = 0x165667B19E3779F9ull;
+
+static inline uint64_t hashRound(uint64_t lane, uint64_t word)
+{
+    return rotateLeft(lane + word * hashPrime2, 31) * hashPrime1;
+}
+
+uint64_t TokenCache::hashSource(string_view source, uint64_t seed)
+{
+    const char* runner = source.data();
+    const char* end = runner + source.size();
+
+    // Four lanes, so the multiplies of the different lanes overlap.
+    uint64_t lanes[4] = { seed + hashPrime1 + hashPrime2, seed + hashPrime2, seed, seed - hashPrime1 };
+    for (; runner + 32 <= end; runner += 32)
+    {
+        lanes[0] = hashRound(lanes[0], readWord(runner));
+        lanes[1] = hashRound(lanes[1], readWord(runner + 8));
+        lanes[2] = hashRound(lanes[2], readWord(runner + 16));
+        lanes[3] = hashRound(lanes[3], readWord(runner + 24));
+    }
+
+    uint64_t hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+    hash += source.size();
+
+    for (; runner + 8 <= end; runner += 8) hash = rotateLeft(hash ^ hashRound(0, readWord(runner)), 27) * hashPrime1 + hashPrime3;
+    for (; runner < end; runner++) hash = rotateLeft(hash ^ ((unsigned char)*runner * hashPrime3), 11) * hashPrime1;
+
+    hash ^= hash >> 33;
+    hash *= hashPrime2;
+    hash ^= hash >> 29;
+    hash *= hashPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+boost::filesystem::path TokenCache::pathFor(uint64_t contentHash) const
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    uint64_t key = contentHash ^ (grammarKey * hashPrime3);
+
+    char name[16 + sizeof(".tokens")];
+    for (int i = 0; i < 16; i++) name[i] = hexDigits[(key >> (60 - 4 * i)) & 0xF];
+    memcpy(name + 16, ".tokens", sizeof(".tokens"));
+
+    return directory / name;
+}
+
+bool TokenCache::load(string_view source, token_vector& target, bool needPositions) const
+{
+    uint64_t contentHash = hashSource(source);
+
+    TokenCacheFile cacheFile;
+    if (!cacheFile.open(pathFor(contentHash), source, contentHash, hashSource(source, checkSeed), grammarKey)) return false;
+    if (needPositions && !cacheFile.hasPositions()) return false;
+
+    cacheFile.appendTo(target, source);
+    return true;
+}
+
+bool TokenCache::store(string_view source, const token_vector& tokens, size_t first, bool hasPositions)
+{
+    // The offsets are 32 bit
+    if (source.size() > UINT32_MAX || first > tokens.size()) return false;
+
+    TokenCacheHeader header;
+    header.fileMagic = TokenCacheHeader::magic;
+    header.version = TokenCacheHeader::currentVersion;
+    header.flags = hasPositions ? 0 : TokenCacheHeader::noPositions;
+    header.recordSize = sizeof(TokenCacheRecord);
+    header.grammarKey = grammarKey;
+    header.contentHash = hashSource(source);
+    header.checkHash = hashSource(source, checkSeed);
+    header.sourceSize = source.size();
+    header.tokenCount = tokens.size() - first;
+
+    vector<TokenCacheRecord> records;
+    records.reserve(tokens.size() - first);
+    for (size_t i = first; i < tokens.size(); i++)
+    {
+        const Token& token = tokens[i];
+
+        // A token from somewhere else can not be saved as an offset
+        if (token.tokenString.data() < source.data() || token.tokenString.data() + token.tokenString.size() > source.data() + source.size()) return false;
+
+        TokenCacheRecord& record = records.emplace_back();
+        record.offset = (uint32_t)(token.tokenString.data() - source.data());
+        record.length = (uint32_t)token.tokenString.size();
+        record.startingLine = (int32_t)token.startingLine;
+        record.startingCharacter = (int32_t)token.startingCharacter;
+        record.setToken(token);
+    }
+
+    boost::filesystem::path cachePath = pathFor(header.contentHash);
+
+    // Write it under a name of its own, then rename, so a reader never sees half a file.
+    boost::filesystem::path writePath = cachePath;
+    string writeSuffix = ".";
+    writeSuffix += to_string(writeCount++);
+    writeSuffix += boost::filesystem::unique_path("-%%%%%%%%.tmp").string();
+    writePath += writeSuffix;
+
+    {
+        ofstream output(writePath.string(), ios::binary | ios::trunc);
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        output.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(TokenCacheRecord));
+        if (!output)
+        {
+            output.close();
+            boost::system::error_code error;
+            boost::filesystem::remove(writePath, error);
+            return false;
+        }
+    }
+
+    boost::system::error_code error;
+    boost::filesystem::rename(writePath, cachePath, error);
+    if (error)
+    {
+        boost::filesystem::remove(writePath, error);
+        return false;
+    }
+
+    return true;
+}
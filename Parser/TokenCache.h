@@ -0,0 +1,137 @@
+#ifndef TOKEN_CACHE_H_INCLUDED
+#define TOKEN_CACHE_H_INCLUDED
+
+#include "Tokenizer.h"
+
+#include <atomic>
+#include <cstdint>
+
+/*
+* Tokens saved on disk, so a source that has not changed is not scanned again.
+*
+*   TokenCache cache("build/tokens", 1);
+*   tokenizer.tokenCache = &cache;
+*   tokenizer.tokenize(filePath);      // scans and saves the first time, loads after that
+*
+* The cache files are named by a hash of the source bytes, not the path - a file that was touched but not
+* changed, or a copy of the same file, still uses the saved tokens.  grammarKey is in the hash and the header too,
+* change it when the grammar changes.
+*
+* A cache file is a TokenCacheHeader followed by a TokenCacheRecord for each token, so it is memory mapped and
+* read in place (TokenCacheFile) - there is no parsing.  The atoms are not saved, they are interned again when
+* Tokenizer::atoms is set.  Tokens saved by a lazyPositions scan are only loaded for another lazyPositions scan.
+*
+* Files are written to a temporary name and renamed, so any number of threads and processes can share a cache.
+* A file that does not match (another version, cut short) is just a miss.  The bytes of the source are not kept, so
+* the file is matched by hashes: the 64 bit contentHash names it, and a second 64 bit hash of the source with another
+* seed (checkHash) is in the header.  A file for another source of the same size is only loaded if both collide.
+* The hashes are not cryptographic - do not share a cache directory with anyone who could write into it.
+*/
+struct TokenCacheHeader
+{
+    static constexpr uint32_t magic = 0x43545053;      // "SPTC"
+    static constexpr uint32_t currentVersion = 2;
+
+    // Saved from a Tokenizer::lazyPositions scan - the lines and characters are all 0.
+    static constexpr uint32_t noPositions = 1;
+
+    uint32_t    fileMagic;
+    uint32_t    version;
+    uint32_t    flags;
+    uint32_t    recordSize;         // sizeof(TokenCacheRecord), in case the layout changes without a new version
+    uint64_t    grammarKey;
+    uint64_t    contentHash;
+    uint64_t    checkHash;
+    uint64_t    sourceSize;
+    uint64_t    tokenCount;
+};
+
+struct TokenCacheRecord
+{
+    // typeFlags also has Token::hasEscape and Token::keywordId
+    static constexpr int32_t typeMask = 0x0000FFFF;
+    static constexpr int32_t keywordMask = 0x3FFF0000;
+    static constexpr int32_t keywordShift = 16;
+    static constexpr int32_t hasEscapeFlag = 0x40000000;
+
+    void setToken(const Token& token)
+    {
+        typeFlags = (int32_t)(token.typeFlags & typeMask) | (((int32_t)token.keywordId << keywordShift) & keywordMask) | (token.hasEscape ? hasEscapeFlag : 0);
+    }
+
+    void getToken(Token& token) const
+    {
+        token.typeFlags = typeFlags & typeMask;
+        token.keywordId = (uint16_t)((typeFlags & keywordMask) >> keywordShift);
+        token.hasEscape = 0 != (typeFlags & hasEscapeFlag);
+    }
+
+    uint32_t    offset;             // From the start of the source
+    uint32_t    length;
+    int32_t     startingLine;
+    int32_t     startingCharacter;
+    int32_t     typeFlags;
+};
+
+// A mapped cache file, read in place.
+class EXPORT TokenCacheFile
+{
+protected:
+    mapped_file_source          mappedFile;
+    const TokenCacheHeader*     header;
+    const TokenCacheRecord*     records;
+
+public:
+    TokenCacheFile() : header(NULL), records(NULL) {}
+
+    // False if the file is missing or is not the tokens of source.
+    bool open(const boost::filesystem::path& cachePath, string_view source, uint64_t contentHash, uint64_t checkHash, uint64_t grammarKey);
+
+    bool hasPositions() const { return isOpen() && 0 == (header->flags & TokenCacheHeader::noPositions); }
+    void close();
+
+    bool isOpen() const { return NULL != header; }
+
+    size_t size() const { return isOpen() ? (size_t)header->tokenCount : 0; }
+    const TokenCacheRecord& record(size_t index) const { return records[index]; }
+
+    // The Token for a record, its tokenString is in source.
+    Token token(size_t index, string_view source) const;
+
+    // Add all the tokens to target.
+    void appendTo(token_vector& target, string_view source) const;
+};
+
+class EXPORT TokenCache
+{
+protected:
+    boost::filesystem::path     directory;
+    uint64_t                    grammarKey;
+
+    // For unique temporary file names
+    atomic<uint64_t>            writeCount;
+
+public:
+    // The directory is made if it is not there.
+    TokenCache(boost::filesystem::path inDirectory, uint64_t inGrammarKey = 0);
+
+    TokenCache(const TokenCache&) = delete;
+    TokenCache& operator=(const TokenCache&) = delete;
+
+    // A fast 64 bit hash of the source bytes - not for security.  The source size has to match as well.
+    // The checkHash is the same hash with checkSeed.
+    static uint64_t hashSource(string_view source, uint64_t seed = 0);
+    static constexpr uint64_t checkSeed = 0x27D4EB2F165667C5ull;
+
+    boost::filesystem::path pathFor(uint64_t contentHash) const;
+
+    // Add the saved tokens for source to target.  False (and target is not changed) if there are none,
+    // or if needPositions and they were saved without.
+    bool load(string_view source, token_vector& target, bool needPositions = true) const;
+
+    // Save the tokens of source - tokens from first on, which must all be in source.
+    // Returns false if they could not be saved, the cache is only a speed up so that is not an error.
+    bool store(string_view source, const token_vector& tokens, size_t first = 0, bool hasPositions = true);
+};
+
+#endif // TOKEN_CACHE_H_INCLUDED
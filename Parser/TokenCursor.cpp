@@ -0,0 +1,100 @@
+#include "pch.h"
+#include "TokenCursor.h"
+
+// How far past the next token scanNext goes.  A few hundred tokens per scan is close to the speed of
+// tokenize, a token at a time is about 40% slower.
+static const size_t scanAheadBytes = 4096;
+
+TokenCursor::TokenCursor(Tokenizer& inTokenizer, ReadFileData& inSource, size_t lookahead) :
+    tokenizer(inTokenizer),
+    source(&inSource),
+    ownsSource(false)
+{
+    runner = source->start();
+    start(lookahead);
+}
+
+TokenCursor::TokenCursor(Tokenizer& inTokenizer, boost::filesystem::path& filePath, size_t lookahead) :
+    tokenizer(inTokenizer),
+    source(new ReadFileData()),
+    ownsSource(true)
+{
+    runner = source->readInFile(filePath);
+    start(lookahead);
+}
+
+TokenCursor::TokenCursor(Tokenizer& inTokenizer, string_view stringBuffer, size_t lookahead) :
+    tokenizer(inTokenizer),
+    source(new ReadFileData()),
+    ownsSource(true)
+{
+    runner = source->useExistingBuffer(stringBuffer.data(), stringBuffer.size());
+    start(lookahead);
+}
+
+TokenCursor::~TokenCursor()
+{
+    if (ownsSource) delete source;
+}
+
+void TokenCursor::start(size_t lookahead)
+{
+    end = source->end();
+    position = tokenizer.firstPosition();
+    endOfInputAdded = false;
+    first = 0;
+
+    window.reserve(2 * max<size_t>(lookahead, 1));
+
+    skipByteOrderMark(runner, end);
+
+    // Skip the leading whitespace - stopping at runner adds no tokens.
+    if (NULL != runner && runner < end)
+    {
+        (*tokenizer.grammar->scanner)(tokenizer, window, runner, runner, end, position);
+    }
+}
+
+bool TokenCursor::scanNext()
+{
+    if (endOfInputAdded) return false;
+
+    auto scanner = tokenizer.activeScanner();
+
+    // runner is at the start of a token, so this scans at least that token.
+    const char* stopAt = (size_t)(end - runner) > scanAheadBytes ? runner + scanAheadBytes : end;
+    size_t scanned = window.size();
+    if (runner < end && (*scanner)(tokenizer, window, runner, stopAt, end, position))
+    {
+        tokenizer.internIdentifiers(window, scanned);
+        return true;
+    }
+
+    window.emplace_back(position.lineNumber, position.characterNumber, Token::endOfInput).tokenString = string_view(end, 0);
+    endOfInputAdded = true;
+
+    return true;
+}
+
+Token& TokenCursor::peek(size_t ahead)
+{
+    while (window.size() - first <= ahead && scanNext());
+
+    return window[min(first + ahead, window.size() - 1)];
+}
+
+bool TokenCursor::next()
+{
+    if (atEnd()) return false;
+
+    first++;
+
+    // Drop the used tokens once they are the bigger part of the window
+    if (first >= window.size() - first)
+    {
+        window.erase(window.begin(), window.begin() + first);
+        first = 0;
+    }
+
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef TOKEN_CURSOR_H_INCLUDED
+#define TOKEN_CURSOR_H_INCLUDED
+
+#include "Tokenizer.h"
+
+/*
+* A pull style token stream.  Tokens are scanned when they are asked for, so a parser can work while the
+* source is scanned and the whole token_vector is never built.
+*
+*   TokenCursor cursor(tokenizer, filePath);
+*   do
+*   {
+*       Token& token = cursor.current();
+*       if (Token::block_start == cursor.peek(1).typeFlags) ...
+*   } while (cursor.next());
+*
+* Only the tokens from current() to the furthest peek, and the rest of the last 4K scanned, are kept.
+* A Token& is good until the next peek or next, copy the Token to keep it longer.
+* The last token is endOfInput, and the cursor stays on it.  The Tokenizer's grammar and lazyPositions are used,
+* but nothing is added to its tokens.
+*/
+class EXPORT TokenCursor
+{
+protected:
+    Tokenizer&      tokenizer;
+    ReadFileData*   source;
+    bool            ownsSource;
+
+    const char*     runner;
+    const char*     end;
+    ScanPosition    position;
+    bool            endOfInputAdded;
+
+    // The scanned tokens, current() is at first.
+    token_vector    window;
+    size_t          first;
+
+    void start(size_t lookahead);
+
+    // Scan one more token into the window.  Returns false when there are no more.
+    bool scanNext();
+
+public:
+    // lookahead is how many tokens to make room for - peek can go further, the window just grows.
+    TokenCursor(Tokenizer& inTokenizer, ReadFileData& inSource, size_t lookahead = 8);
+    TokenCursor(Tokenizer& inTokenizer, boost::filesystem::path& filePath, size_t lookahead = 8);
+    TokenCursor(Tokenizer& inTokenizer, string_view stringBuffer, size_t lookahead = 8);
+    ~TokenCursor();
+
+    Token& current() { return peek(0); }
+
+    // The token ahead of current().  endOfInput past the end.
+    Token& peek(size_t ahead);
+
+    // Move to the next token.  Returns false if current() is endOfInput.
+    bool next();
+
+    bool atEnd() { return Token::endOfInput == current().typeFlags; }
+};
+
+#endif // TOKEN_CURSOR_H_INCLUDED
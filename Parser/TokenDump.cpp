@@ -0,0 +1,233 @@
+#include "pch.h"
+#include "TokenDump.h"
+
+#include <charconv>
+
+extern "C++" EXPORT bool parseTokenDumpFormat(string_view name, TokenDumpFormat& format)
+{
+    if ("human"sv == name) format = TokenDumpFormat::human;
+    else if ("json"sv == name) format = TokenDumpFormat::jsonLines;
+    else if ("binary"sv == name) format = TokenDumpFormat::binary;
+    else if ("summary"sv == name) format = TokenDumpFormat::summary;
+    else return false;
+
+    return true;
+}
+
+TokenDumper::TokenDumper(ostream& inOutput, TokenDumpFormat inFormat, size_t inBufferSize) :
+    output(inOutput),
+    format(inFormat),
+    bufferSize(max<size_t>(inBufferSize, 4096)),
+    tokenIndex(0),
+    started(false)
+{
+    buffer.reserve(bufferSize + 1024);
+    typeCounts.fill(0);
+    typeBytes.fill(0);
+}
+
+TokenDumper::~TokenDumper()
+{
+    flush();
+}
+
+void TokenDumper::appendNumber(int64_t number)
+{
+    char digits[24];
+    auto result = to_chars(digits, digits + sizeof(digits), number);
+    buffer.append(digits, result.ptr - digits);
+}
+
+void TokenDumper::appendJsonString(string_view text)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    buffer += '"';
+
+    // Copy the runs that need no escape in one go
+    const char* run = text.data();
+    const char* end = text.data() + text.size();
+    for (const char* runner = run; runner < end; runner++)
+    {
+        unsigned char c = (unsigned char)*runner;
+        if (0x20 <= c && c < 0x80 && '"' != c && '\\' != c) continue;
+
+        if (0x80 <= c)
+        {
+            // Good utf8 is copied, a bad byte would make the line bad JSON - it is U+FFFD instead.
+            size_t length = ReadFileData::utf8SequenceLength((const unsigned char*)runner, (const unsigned char*)end);
+            if (0 < length)
+            {
+                runner += length - 1;
+                continue;
+            }
+        }
+
+        buffer.append(run, runner - run);
+        run = runner + 1;
+
+        switch (c)
+        {
+        case '"':   buffer += "\\\""; break;
+        case '\\':  buffer += "\\\\"; break;
+        case '\n':  buffer += "\\n"; break;
+        case '\r':  buffer += "\\r"; break;
+        case '\t':  buffer += "\\t"; break;
+        default:
+            if (0x80 <= c)
+            {
+                buffer += "\\ufffd";
+                break;
+            }
+
+            buffer += "\\u00";
+            buffer += hexDigits[c >> 4];
+            buffer += hexDigits[c & 0xF];
+            break;
+        }
+    }
+    buffer.append(run, end - run);
+
+    buffer += '"';
+}
+
+// Type names as TokenFlagToString has them
+static void appendTypeName(string& buffer, long typeFlags)
+{
+    long flagRemoved = typeFlags & ~Token::packageName;
+
+    string_view name = tokenTypeName(flagRemoved);
+    if (!name.empty()) buffer += name;
+    else buffer += to_string(flagRemoved);
+
+    if (0 != (typeFlags & Token::packageName)) buffer += " packageName";
+}
+
+void TokenDumper::dumpHuman(const Token& token)
+{
+    // The same text as the ostream version always wrote, typo and all - there are scripts that read it.
+    append("TokenIndex:  "sv);
+    appendNumber(tokenIndex);
+    append("  String: "sv);
+    append(token.tokenString);
+    append("\nLine: "sv);
+    appendNumber(token.startingLine);
+    append("  Characer: "sv);
+    appendNumber(token.startingCharacter);
+    append("\nType: "sv);
+    appendTypeName(buffer, token.typeFlags);
+    append("\n\n"sv);
+}
+
+void TokenDumper::dumpJson(const Token& token)
+{
+    append("{\"index\":"sv);
+    appendNumber(tokenIndex);
+    append(",\"type\":\""sv);
+    appendTypeName(buffer, token.typeFlags);
+    append("\",\"line\":"sv);
+    appendNumber(token.startingLine);
+    append(",\"character\":"sv);
+    appendNumber(token.startingCharacter);
+    append(",\"text\":"sv);
+    appendJsonString(token.tokenString);
+    append("}\n"sv);
+}
+
+void TokenDumper::dumpBinary(const Token& token)
+{
+    TokenDumpRecord record;
+    record.typeFlags = (int32_t)token.typeFlags;
+    record.startingLine = (int32_t)token.startingLine;
+    record.startingCharacter = (int32_t)token.startingCharacter;
+    record.length = (uint32_t)token.tokenString.size();
+
+    buffer.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    append(token.tokenString);
+}
+
+void TokenDumper::dump(const token_vector& tokens)
+{
+    if (!started)
+    {
+        started = true;
+        if (TokenDumpFormat::binary == format)
+        {
+            TokenDumpHeader header;
+            header.fileMagic = TokenDumpHeader::magic;
+            header.version = TokenDumpHeader::currentVersion;
+            buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+    }
+
+    for (auto& token : tokens)
+    {
+        switch (format)
+        {
+        case TokenDumpFormat::human:
+            dumpHuman(token);
+            break;
+        case TokenDumpFormat::jsonLines:
+            dumpJson(token);
+            break;
+        case TokenDumpFormat::binary:
+            dumpBinary(token);
+            break;
+        case TokenDumpFormat::summary:
+            if (0 <= token.typeFlags && (size_t)token.typeFlags < tokenTypeNameCount)
+            {
+                typeCounts[token.typeFlags]++;
+                typeBytes[token.typeFlags] += token.tokenString.size();
+            }
+            break;
+        }
+
+        tokenIndex++;
+        if (buffer.size() >= bufferSize) flush();
+    }
+}
+
+void TokenDumper::writeSummary()
+{
+    uint64_t tokenCount = 0;
+    uint64_t byteCount = 0;
+    for (size_t type = 0; type < tokenTypeNameCount; type++)
+    {
+        tokenCount += typeCounts[type];
+        byteCount += typeBytes[type];
+    }
+
+    append("Tokens: "sv);
+    appendNumber((int64_t)tokenCount);
+    append("  Bytes: "sv);
+    appendNumber((int64_t)byteCount);
+    append("\n"sv);
+
+    for (size_t type = 0; type < tokenTypeNameCount; type++)
+    {
+        if (0 == typeCounts[type]) continue;
+
+        append("  "sv);
+        size_t nameStart = buffer.size();
+        appendTypeName(buffer, (long)type);
+        if (buffer.size() - nameStart < 24) buffer.append(24 - (buffer.size() - nameStart), ' ');
+        appendNumber((int64_t)typeCounts[type]);
+        append(" tokens  "sv);
+        appendNumber((int64_t)typeBytes[type]);
+        append(" bytes\n"sv);
+    }
+}
+
+void TokenDumper::flush()
+{
+    if (buffer.empty()) return;
+
+    output.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+void TokenDumper::finish()
+{
+    if (TokenDumpFormat::summary == format) writeSummary();
+    flush();
+}
@@ -0,0 +1,102 @@
+#ifndef TOKEN_DUMP_H_INCLUDED
+#define TOKEN_DUMP_H_INCLUDED
+
+#include "Tokenizer.h"
+
+#include <cstdint>
+
+/*
+* Writing tokens out, for tools and pipelines.
+*
+*   TokenDumper dumper(std::cout, TokenDumpFormat::jsonLines);
+*   dumper.dump(tokenizer.tokens);
+*   dumper.finish();
+*
+* The text is built in a buffer that is written out when it fills, so there is one write for many tokens and
+* nothing is flushed per line.  dump can be called for each chunk from tokenizeStream, the index keeps counting.
+*
+* Formats:
+*   human       The dumpTokens text - index, string, line, character and type for each token.
+*   jsonLines   One JSON object per token:  {"index":0,"type":"identifier","line":1,"character":1,"text":"count"}
+*               The text is escaped for JSON.  Good utf8 is passed through as it is, a byte that is not is \ufffd.
+*   binary      A TokenDumpHeader, then a TokenDumpRecord and its text bytes for each token.  Native byte order.
+*   summary     Nothing per token - finish writes the number of tokens and bytes for each type.
+*/
+enum class TokenDumpFormat
+{
+    human,
+    jsonLines,
+    binary,
+    summary,
+};
+
+// False if name is not human, json, binary or summary.
+extern "C++" EXPORT bool parseTokenDumpFormat(string_view name, TokenDumpFormat& format);
+
+struct TokenDumpHeader
+{
+    static constexpr uint32_t magic = 0x4B545053;      // "SPTK"
+    static constexpr uint32_t currentVersion = 1;
+
+    uint32_t    fileMagic;
+    uint32_t    version;
+};
+
+// Followed by length bytes of the tokenString.
+struct TokenDumpRecord
+{
+    int32_t     typeFlags;
+    int32_t     startingLine;
+    int32_t     startingCharacter;
+    uint32_t    length;
+};
+
+class EXPORT TokenDumper
+{
+protected:
+    ostream&            output;
+    TokenDumpFormat     format;
+
+    string              buffer;
+    size_t              bufferSize;
+
+    // The next index, and (after the first dump) that the binary header is written.
+    int64_t             tokenIndex;
+    bool                started;
+
+    // For the summary
+    array<uint64_t, tokenTypeNameCount> typeCounts;
+    array<uint64_t, tokenTypeNameCount> typeBytes;
+
+    void append(string_view text) { buffer.append(text); }
+    void appendNumber(int64_t number);
+    void appendJsonString(string_view text);
+
+    void dumpHuman(const Token& token);
+    void dumpJson(const Token& token);
+    void dumpBinary(const Token& token);
+
+    void writeSummary();
+
+public:
+    TokenDumper(ostream& inOutput, TokenDumpFormat inFormat = TokenDumpFormat::human, size_t inBufferSize = 1024 * 1024);
+
+    // Flushes what is left, but a summary is only written by finish.
+    ~TokenDumper();
+
+    TokenDumper(const TokenDumper&) = delete;
+    TokenDumper& operator=(const TokenDumper&) = delete;
+
+    void dump(const token_vector& tokens);
+
+    // The index of the next token dumped - set it for chunks that do not start at 0.
+    void setTokenIndex(int64_t index) { tokenIndex = index; }
+
+    // Write out the buffer.  The output stream is not flushed.
+    void flush();
+
+    // The summary, for that format, and flush.
+    void finish();
+};
+
+#endif // TOKEN_DUMP_H_INCLUDED
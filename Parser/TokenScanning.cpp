@@ -1,4 +1,5 @@
 #include "pch.h"
+#include "SimdScanning.h"
 
 using namespace std;
 
@@ -10,37 +11,34 @@ MatchInfo StartEndMatcher(const char* start, const char* end, char startEnd)
 
     if (runner < end && startEnd == *runner)
     {
-        bool isEscaped = false;
+        const char* lastNewline = NULL;
         while (++runner < end)
         {
-            if (!isEscaped && startEnd == *runner)
+            // Jump to the next startEnd or \ - counting the '\n' on the way
+            runner = scanKernels->scanToEither(runner, end, startEnd, '\\', result.lines, lastNewline);
+            if (runner == end) break;
+
+            if (startEnd == *runner)
             {
                 // +1 include the final quote
                 result.length = 1L + (runner - start);
+                result.chars = static_cast<long>(runner + 1 - ((NULL != lastNewline) ? lastNewline + 1 : start));
                 result.id = startEnd;
 
                 return result;
             }
-            else if ('\\' == *runner)
-            {
-                // \ must toggle - \" = escaped, \\" = \ escaped " not, \\\" \ escaped " escaped  
-                isEscaped = !isEscaped;
-            }
-            else if ('\n' == *runner)
+
+            // \ escapes the next character - \" = escaped, \\" = \ escaped " not, \\\" \ escaped " escaped
+            result.hasEscape = true;
+            if (++runner < end && '\n' == *runner)
             {
                 result.lines++;
-                result.chars = 0;   // 0 -> result.chars++ will happen before looping
-                isEscaped = false;
-            }
-            else
-            {
-                isEscaped = false;
+                lastNewline = runner;
             }
-            result.chars++;
         }
     }
 
-    return result;  // Non  match
+    return MatchInfo();  // Non  match
 };
 
 MatchInfo HexMatcher(const char* start, const char* end, char special, const bool prefixMatched)
@@ -71,15 +69,13 @@ MatchInfo HexMatcher(const char* start, const char* end, char special, const boo
         pos += 2;
     }
 
-    while (pos < end && (('0' <= *pos && *pos <= '9') ||
-        ('a' <= *pos && *pos <= 'f') ||
-        ('A' <= *pos && *pos <= 'F')))
+    while (pos < end && isHexDigitChar(*pos))
     {
         pos++;
         isHex = true;
     }
 
-    if (isHex && ((pos == end) || ispunct(*pos) || isspace(*pos)))
+    if (isHex && ((pos == end) || isCharacterClass(*pos, charPunctuation | charSpace)))
     {
         // Single line we have not crossed \n
         result.chars = static_cast<long>(result.length = pos - start);
@@ -146,8 +142,8 @@ MatchInfo NuberMatcher(const char* start, const char* end, char special)
         pos++;
     }
 
-    if ((valid && ((pos == end) || isspace(*pos)
-        || (ispunct(*pos) && '-' != *pos && '.' != *pos))))
+    if ((valid && ((pos == end) || isSpaceChar(*pos)
+        || (isPunctuationChar(*pos) && '-' != *pos && '.' != *pos))))
     {
         // Single line we have not crossed \n
         result.chars = static_cast<long>(result.length = pos - start);
@@ -166,9 +162,9 @@ MatchInfo IdentifierMatcher(const char* start, const char* end, char special)
     // This means some utf8 punctuation can be used in identifiers, but that is OK
 
     bool oneTimeMatch;
-    if (pos < end && (isprint(*pos) || (0x80 & *pos)) &&
+    if (pos < end && isCharacterClass(*pos, charPrintable | charMultiByte) &&
         ((oneTimeMatch = 0 != special && special == *pos) ||
-            ('_' == *pos || (!ispunct(*pos) && !isspace(*pos) && !isdigit(*pos)))))
+            ('_' == *pos || !isCharacterClass(*pos, charPunctuation | charSpace | charDigit))))
     {
         pos++;
 
@@ -178,18 +174,12 @@ MatchInfo IdentifierMatcher(const char* start, const char* end, char special)
             special = 0;
         }
 
-        // Digits allowed now.
-        while (pos < end && (isprint(*pos) || (0x80 & *pos)) &&
-            ((oneTimeMatch = 0 != special && special == *pos) ||
-                ('_' == *pos || (!ispunct(*pos) && !isspace(*pos)))))
+        // Digits allowed now.  The special can still be matched once in the middle.
+        pos = scanKernels->skipIdentifier(pos, end);
+        if (pos < end && 0 != special && special == *pos)
         {
-            pos++;
-
-            if (oneTimeMatch)
-            {
-                result.id = special;   // Use the special as the special identifier
-                special = 0;
-            }
+            result.id = special;   // Use the special as the special identifier
+            pos = scanKernels->skipIdentifier(pos + 1, end);
         }
 
         // Single line we have not crossed \n
@@ -204,20 +194,11 @@ MatchInfo WhiteSpaceMatcher(const char* start, const char* end, char special)
 {
     MatchInfo result;
 
-    const char* pos = start;
-
-    while (pos < end && isspace(*pos))
-    {
-        if ('\n' == *pos)
-        {
-            result.lines++;
-            result.chars = 0;   // 0 -> result.chars++ will happen before looping
-        }
-        pos++;
-        result.chars++;
-    }
+    const char* lastNewline = NULL;
+    const char* pos = scanKernels->skipWhitespace(start, end, result.lines, lastNewline);
 
     result.length = pos - start;
+    result.chars = static_cast<long>(pos - ((NULL != lastNewline) ? lastNewline + 1 : start));
     if (0 < result.length) result.id = ' ';  // ' ' whitespace identifier
 
     return result;
@@ -229,7 +210,7 @@ MatchInfo PunctuationMatch(const char* start, const char* end, char special)
 
     const char* pos = start;
 
-    if (ispunct(*start))
+    if (start < end && isPunctuationChar(*start))
     {
         result.length = 1;
         result.id = '|';  // '|' punctuation identifier
@@ -247,12 +228,11 @@ MatchInfo LineCommentMatcher(const char* start, const char* end, char special)
 
     if (pos < end && special == *pos)
     {
-        while (pos < end && '\n' != *pos) pos++;
+        pos = scanKernels->findCharacter(pos, end, '\n');
 
-        result.length = pos - start;
+        // The '\n' is left for the whitespace, so the comment stays on one line.
+        result.chars = static_cast<long>(result.length = pos - start);
         result.id = special;  // special - the comment characer
-        result.lines = 1;
-        result.chars = 1;
     }
 
     return result;
@@ -1,12 +1,71 @@
 #pragma once
 
+// Locale independent character classes.  These match the "C" locale isspace, isdigit, ispunct and isprint,
+// but they are a single table lookup and they are safe for bytes with 0x80 set (signed char).
+enum CharacterClass : unsigned char
+{
+    charNone = 0,
+    charSpace = 1,
+    charDigit = 2,
+    charHexDigit = 4,
+    charPunctuation = 8,
+    charPrintable = 16,
+    charMultiByte = 32,     // 0x80 set - part of a utf8 sequence
+};
+
+constexpr std::array<unsigned char, 256> makeCharacterClasses()
+{
+    std::array<unsigned char, 256> classes{};
+
+    for (int c = 0; c < 256; c++)
+    {
+        unsigned char flags = charNone;
+
+        if (' ' == c || ('\t' <= c && c <= '\r')) flags |= charSpace;
+        if ('0' <= c && c <= '9') flags |= charDigit | charHexDigit;
+        if (('a' <= c && c <= 'f') || ('A' <= c && c <= 'F')) flags |= charHexDigit;
+        if (0x20 <= c && c <= 0x7E) flags |= charPrintable;
+        if (0x21 <= c && c <= 0x7E && !(('0' <= c && c <= '9') || ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z'))) flags |= charPunctuation;
+        if (0x80 & c) flags |= charMultiByte;
+
+        classes[c] = flags;
+    }
+
+    return classes;
+}
+
+inline constexpr std::array<unsigned char, 256> characterClasses = makeCharacterClasses();
+
+inline bool isCharacterClass(char c, unsigned char classFlags) { return 0 != (characterClasses[(unsigned char)c] & classFlags); }
+inline bool isSpaceChar(char c) { return isCharacterClass(c, charSpace); }
+inline bool isDigitChar(char c) { return isCharacterClass(c, charDigit); }
+inline bool isHexDigitChar(char c) { return isCharacterClass(c, charHexDigit); }
+inline bool isPunctuationChar(char c) { return isCharacterClass(c, charPunctuation); }
+
+// The tokenReadingMap key for a character.  All digits look up '0' and all identifier characters look up 'a'.
+constexpr char lookupCharacter(char c)
+{
+    unsigned char classes = characterClasses[(unsigned char)c];
+
+    // Map all digits to 0 for simplified lookup
+    if (classes & charDigit) return '0';
+
+    if ((classes & (charPrintable | charMultiByte)) && (!(classes & charPunctuation) || ':' == c) && !(classes & charSpace))
+    {
+        return 'a';  // Start of an itentifier - match them all to 'a'
+    }
+
+    return c;
+}
+
 // These are all utility founctions for finding typed tokens
 struct MatchInfo
 {
     size_t  length;
-    long    lines;
-    long    chars;
+    long    lines;      // The number of '\n' matched
+    long    chars;      // The characters matched, or when lines > 0 the characters after the last '\n'
     char    id;
+    bool    hasEscape;  // StartEndMatcher passed a \ escape
 
 
     void clear()
@@ -15,12 +74,20 @@ struct MatchInfo
         lines = 0;
         chars = 0;
         id = 0;
+        hasEscape = false;
     }
 
     MatchInfo()
     {
         clear();
     }
+
+    // Move a line / character position past this match.
+    void advance(long& lineNumber, long& characterNumber) const
+    {
+        lineNumber += lines;
+        characterNumber = (0 < lines) ? 1 + chars : characterNumber + chars;
+    }
 };
 
 // I wanted to use regex for the tokenMatcher but C++ has regex issues
@@ -0,0 +1,72 @@
+#include "pch.h"
+#include "TokenTrivia.h"
+
+size_t TokenTrivia::separate(token_vector& tokens, size_t first, const char* sourceStart)
+{
+    if (first >= tokens.size()) return 0;
+
+    // The whitespace is the gap between one token and the next - the scan only skips whitespace between tokens.
+    const char* previousEnd = NULL;
+    if (keepWhitespace && NULL != sourceStart)
+    {
+        previousEnd = sourceStart;
+        skipByteOrderMark(previousEnd, tokens[first].tokenString.data());
+    }
+
+    size_t kept = first;
+    for (size_t i = first; i < tokens.size(); i++)
+    {
+        Token& token = tokens[i];
+
+        if (NULL != previousEnd)
+        {
+            const char* tokenStart = token.tokenString.data();
+            if (previousEnd < tokenStart)
+            {
+                TriviaEntry& whitespace = entries.emplace_back();
+                whitespace.tokenIndex = (uint32_t)kept;
+                whitespace.token.typeFlags = Token::whitespace;
+                whitespace.token.tokenString = string_view(previousEnd, tokenStart - previousEnd);
+            }
+            previousEnd = tokenStart + token.tokenString.size();
+        }
+
+        if (isTrivia(token))
+        {
+            TriviaEntry& comment = entries.emplace_back();
+            comment.tokenIndex = (uint32_t)kept;
+            comment.token = token;
+        }
+        else
+        {
+            if (kept != i) tokens[kept] = token;
+            kept++;
+        }
+    }
+
+    size_t removed = tokens.size() - kept;
+    tokens.resize(kept);
+
+    return removed;
+}
+
+size_t TokenTrivia::drop(token_vector& tokens, size_t first)
+{
+    if (first >= tokens.size()) return 0;
+
+    auto kept = remove_if(tokens.begin() + first, tokens.end(), [](const Token& token) { return isTrivia(token); });
+    size_t removed = tokens.end() - kept;
+    tokens.erase(kept, tokens.end());
+
+    return removed;
+}
+
+span<const TriviaEntry> TokenTrivia::before(size_t tokenIndex) const
+{
+    auto first = lower_bound(entries.begin(), entries.end(), tokenIndex,
+        [](const TriviaEntry& entry, size_t index) { return entry.tokenIndex < index; });
+    auto last = upper_bound(first, entries.end(), tokenIndex,
+        [](size_t index, const TriviaEntry& entry) { return index < entry.tokenIndex; });
+
+    return span<const TriviaEntry>(entries.data() + (first - entries.begin()), last - first);
+}
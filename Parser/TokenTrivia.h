@@ -0,0 +1,71 @@
+#ifndef TOKEN_TRIVIA_H_INCLUDED
+#define TOKEN_TRIVIA_H_INCLUDED
+
+#include "Tokenizer.h"
+
+#include <cstdint>
+
+// A comment, or a run of whitespace, moved out of the tokens.
+struct TriviaEntry
+{
+    uint32_t    tokenIndex;     // The token it comes before - the endOfInput token for trivia at the end of a source
+    Token       token;          // comment, multiLineComment or whitespace
+};
+
+/*
+* The comments (and the whitespace) of a source, kept beside the tokens instead of in them.
+*
+*   TokenTrivia trivia;
+*   tokenizer.trivia = &trivia;
+*   tokenizer.tokenize(filePath);                           // tokens has no comments
+*   for (auto& entry : trivia.before(tokenIndex)) ...       // the comments just before tokens[tokenIndex]
+*
+* Each entry is attached to the next token, so the trivia between tokens[i - 1] and tokens[i] is before(i), and the
+* trivia after the last token is before the endOfInput token.  The entries are in source order.
+*
+* With keepWhitespace the runs of whitespace between the tokens are entries too, Token::whitespace.  They are found
+* from the gaps between the tokens after the scan, so the scan does not change.  They have no position (line and
+* character 0) - Tokenizer::resolvePosition gives them one.  The comments keep the positions from the scan.
+*
+* The indexes are into the Tokenizer's tokens, and Tokenizer::retokenize of its tokens keeps them up to date.
+* separate can move the trivia out of any other token_vector.
+*/
+class EXPORT TokenTrivia
+{
+    friend class Tokenizer;
+
+protected:
+    vector<TriviaEntry>     entries;
+
+public:
+    // Keep the whitespace between the tokens as well as the comments
+    bool keepWhitespace;
+
+    TokenTrivia(bool inKeepWhitespace = false) : keepWhitespace(inKeepWhitespace) {}
+
+    static bool isTrivia(const Token& token) { return Token::comment == token.typeFlags || Token::multiLineComment == token.typeFlags; }
+
+    // Move the trivia of the tokens from first on into the table, and close up the tokens.  The tokens from first on
+    // must all be from the source at sourceStart (a byte order mark is skipped), after the ones already in the table.
+    // Returns the number of tokens taken out.
+    size_t separate(token_vector& tokens, size_t first, const char* sourceStart);
+
+    // Take the comments from first on out of tokens without keeping them.  Returns the number taken out.
+    static size_t drop(token_vector& tokens, size_t first = 0);
+
+    // The trivia between tokens[tokenIndex - 1] and tokens[tokenIndex]
+    span<const TriviaEntry> before(size_t tokenIndex) const;
+
+    // The trivia between tokens[tokenIndex] and tokens[tokenIndex + 1]
+    span<const TriviaEntry> after(size_t tokenIndex) const { return before(tokenIndex + 1); }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    const TriviaEntry& operator[](size_t index) const { return entries[index]; }
+    vector<TriviaEntry>::const_iterator begin() const { return entries.begin(); }
+    vector<TriviaEntry>::const_iterator end() const { return entries.end(); }
+
+    void clear() { entries.clear(); }
+};
+
+#endif // TOKEN_TRIVIA_H_INCLUDED
@@ -1,4 +1,5 @@
 #include "pch.h"
+#include "SimdScanning.h"
 
 #include <iostream>
 #include <fstream>      // ifstream
@@ -40,6 +41,7 @@ map<long, string_view> Token::tokenTypeNames = map<long, string_view>({
         make_pair(functionReturn, "functionReturn"sv),
         make_pair(selfCall, "selfCall"sv),
         make_pair(compilerFlag, "compilerFlag"sv),
+        make_pair(whitespace, "whitespace"sv),
 
 
         make_pair(packageName, "packageName"sv),
@@ -57,6 +59,7 @@ map<long, string_view> Token::tokenTypeNames = map<long, string_view>({
         make_pair(badNumber, "badNumber"sv),
         make_pair(badPunctuation, "badPunctuation"sv),
         make_pair(badUnknown, "badUnknown"sv),
+        make_pair(badEncoding, "badEncoding"sv),
     });
 
 void Token::init(
@@ -65,6 +68,9 @@ void Token::init(
     int inType)
 {
     hasScope = false;
+    hasEscape = false;
+    keywordId = 0;
+    atom = AtomTable::noAtom;
     startingLine = inStartingLine;
     startingCharacter = inStartingCharacter;
     tokenString = ""sv;
@@ -76,6 +82,9 @@ Token::Token(
     long inStartingCharacter,
     int inType) :
     hasScope(false),
+    hasEscape(false),
+    keywordId(0),
+    atom(AtomTable::noAtom),
     startingLine(inStartingLine),
     startingCharacter(inStartingCharacter),
     tokenString(""sv),
@@ -89,10 +98,10 @@ void TokenFlagToString(string& toAppendFlags, long tokenTypeFlags)
     long flagRemoved = tokenTypeFlags & ~Token::packageName;
     long packageFlag = tokenTypeFlags & Token::packageName;
 
-    auto match = Token::tokenTypeNames.find(flagRemoved);
-    if (match != Token::tokenTypeNames.end())
+    string_view name = tokenTypeName(flagRemoved);
+    if (!name.empty())
     {
-        toAppendFlags += match->second;
+        toAppendFlags += name;
     }
     else
     {
@@ -100,17 +109,7 @@ void TokenFlagToString(string& toAppendFlags, long tokenTypeFlags)
     }
     if (0 != packageFlag)
     {
-        toAppendFlags += " ";
-
-        match = Token::tokenTypeNames.find(packageFlag);
-        if (match != Token::tokenTypeNames.end())
-        {
-            toAppendFlags += match->second;
-        }
-        else
-        {
-            toAppendFlags += to_string(packageFlag);
-        }
+        toAppendFlags += " packageName";
     }
 }
 
@@ -133,7 +132,7 @@ void failTokenToNextWhitespace(Token& token, long faiureCode, long& characterNum
 
     // Advance to the next whitespace. And declare the current "word" an error.
     const char* start = runner;
-    while (runner != end && !isspace(*runner))
+    while (runner != end && !isSpaceChar(*runner))
     {
         runner++;
         characterNumber++;
@@ -142,130 +141,832 @@ void failTokenToNextWhitespace(Token& token, long faiureCode, long& characterNum
 }
 
 
-void Tokenizer::internalTokenize(const char*& runner, const char* end)
+void TokenizerGrammar::buildDispatchTable()
 {
-    long lineNumber = 1;
-    long characterNumber = 1;
+    auto whitespaceMatch = tokenReadingMap.find(' ');
+    whitespaceMatching = (whitespaceMatch != tokenReadingMap.end()) ? whitespaceMatch->second : NULL;
+
+    for (int i = 0; i < 256; i++)
+    {
+        auto match = tokenReadingMap.find(lookupCharacter((char)i));
+        dispatchTable[i] = (match != tokenReadingMap.end()) ? match->second : NULL;
+    }
 
-    // Skip UTF8 BOM if it exists
+    // The map may not match a compile time grammar any more.
+    scanner = &scanTokens<RuntimeGrammar>;
+    offsetScanner = &scanTokens<RuntimeGrammar, false>;
+}
+
+
+// Skip UTF8 BOM if it exists
+void skipByteOrderMark(const char*& runner, const char* end)
+{
     if ((runner + 3 <= end) && (0xEF == (unsigned char)*runner) && (0xBB == (unsigned char)*(runner + 1)) && (0xBF == (unsigned char)*(runner + 2)))
     {
         runner += 3;
     }
+}
 
-    auto whitespaceMatch = tokenReadingMap.find(' ');
-    if (whitespaceMatch != tokenReadingMap.end())
+// Typical source is 8 to 10 bytes per token, less if it is mostly short identifiers and punctuation.
+static const size_t bytesPerToken = 8;
+
+void Tokenizer::reserveTokens(token_vector& target, size_t sourceBytes)
+{
+    size_t needed = target.size() + sourceBytes / bytesPerToken + 1;
+
+    // Still grow by doubling when many sources go into the same tokens.
+    if (target.capacity() < needed) target.reserve(max(needed, target.capacity() * 2));
+}
+
+ReadFileData* Tokenizer::newSourceData()
+{
+    ReadFileData* readData;
+    if (spareFileData.empty())
+    {
+        readData = arena.create<ReadFileData>();
+    }
+    else
+    {
+        readData = spareFileData.back();
+        spareFileData.pop_back();
+    }
+
+    sourceFileData.push_back(readData);
+    return readData;
+}
+
+void Tokenizer::internalTokenize(token_vector& target, ReadFileData* source)
+{
+    const char* runner = source->start();
+    size_t first = target.size();
+
+    scanSource(target, runner, source->end());
+    finishTokens(target, first, source);
+}
+
+void Tokenizer::scanSource(token_vector& target, const char*& runner, const char* end)
+{
+    skipByteOrderMark(runner, end);
+    reserveTokens(target, end - runner);
+
+    ScanPosition position = firstPosition();
+    if ((*activeScanner())(*this, target, runner, end, end, position))
     {
-        auto whitespaceMatcher = whitespaceMatch->second->tokenMatcher;
-        char whiteSpaceSpecial = whitespaceMatch->second->matchOrSpecial;
+        target.emplace_back(position.lineNumber, position.characterNumber, Token::endOfInput).tokenString = string_view(end, 0);
+    }
+}
 
-        while (runner < end)
+void Tokenizer::finishTokens(token_vector& target, size_t first, ReadFileData* source)
+{
+    // The bad bytes first, so a badEncoding token is never interned.
+    checkEncoding(target, first, source);
+    internIdentifiers(target, first);
+
+    // The numbers are recorded by index, so after the trivia is out.
+    separateTrivia(target, first, source->start());
+    recordNumbers(target, first);
+}
+
+void Tokenizer::cachedTokenize(token_vector& target, ReadFileData* source)
+{
+    if (NULL == tokenCache)
+    {
+        internalTokenize(target, source);
+        return;
+    }
+
+    string_view sourceBytes(source->start(), source->end() - source->start());
+    size_t first = target.size();
+
+    // The cache has the tokens as they were scanned - finishTokens is done after it either way.
+    if (!tokenCache->load(sourceBytes, target, !lazyPositions))
+    {
+        const char* runner = source->start();
+        scanSource(target, runner, source->end());
+        tokenCache->store(sourceBytes, target, first, !lazyPositions);
+    }
+
+    finishTokens(target, first, source);
+}
+
+void Tokenizer::internIdentifiers(token_vector& toIntern, size_t first, size_t last)
+{
+    if (NULL == atoms) return;
+
+    last = min(last, toIntern.size());
+    for (size_t i = first; i < last; i++)
+    {
+        Token& token = toIntern[i];
+        if (Token::identifier == (token.typeFlags & ~Token::packageName)) token.atom = atoms->intern(token.tokenString);
+    }
+}
+
+void Tokenizer::recordNumbers(token_vector& target, size_t first)
+{
+    if (NULL != numericValues && &target == &tokens) numericValues->record(target, first);
+}
+
+void Tokenizer::separateTrivia(token_vector& target, size_t first, const char* start)
+{
+    if (dropTrivia) TokenTrivia::drop(target, first);
+    else if (NULL != trivia && &target == &tokens) trivia->separate(target, first, start);
+}
+
+void Tokenizer::checkEncoding(token_vector& target, size_t first, ReadFileData* source)
+{
+    if ((!validateUtf8 && !codePointColumns) || first >= target.size() || NULL == source) return;
+
+    // Nothing to do for ASCII
+    source->checkUtf8();
+    const vector<ReadFileData::NonAsciiRun>& runs = source->nonAscii();
+    if (runs.empty()) return;
+
+    const char* sourceStart = source->start();
+
+    if (validateUtf8)
+    {
+        // Every byte with 0x80 set is in a token - whitespace is ASCII.
+        for (size_t badOffset : source->badUtf8())
         {
+            const char* bad = sourceStart + badOffset;
+            auto token = upper_bound(target.begin() + first, target.end(), bad,
+                [](const char* at, const Token& token) { return at < token.tokenString.data(); });
+            if (token == target.begin() + first) continue;
+            --token;
 
-            // Skip over the whitespace.
-            MatchInfo info = (*whitespaceMatcher)(runner, end, whiteSpaceSpecial);
+            if (bad < token->tokenString.data() + token->tokenString.size()) token->typeFlags = Token::badEncoding;
+        }
+    }
 
-            lineNumber += info.lines;
-            characterNumber += info.chars;
-            runner += info.length;
+    if (codePointColumns && !lazyPositions)
+    {
+        // The tokens and runs are both in source order, so one pass over each.  Only a token with a run between
+        // its line start and itself has any extra bytes to take off.
+        size_t run = 0;
+        for (size_t i = first; i < target.size(); i++)
+        {
+            Token& token = target[i];
+            if (token.startingCharacter <= 1 || !source->contains(token.tokenString.data())) continue;
 
-            char toLookup = *runner;
+            size_t offset = token.tokenString.data() - sourceStart;
+            size_t lineStart = offset - (token.startingCharacter - 1);
 
-            bool is_punct = ispunct(toLookup);
+            while (run + 1 < runs.size() && runs[run + 1].start < offset) run++;
+            if (offset <= runs[run].start || runs[run].end <= lineStart) continue;
 
-            // Map all digits to 0 for simplified lookup
-            if (isdigit(toLookup))
-            {
-                toLookup = '0';
-            }
-            else if ((isprint(toLookup) || (0x80 & toLookup)) && (!is_punct || ':' == toLookup) && !isspace(toLookup) && !isdigit(toLookup))
-            {
-                toLookup = 'a';  // Start of an itentifier - match them all to 'a'
-            }
+            token.startingCharacter -= (long)source->extraBytesBetween(lineStart, offset);
+        }
+    }
+}
+
+
+// One piece of the source for internalTokenizeParallel.
+struct TokenizeChunk
+{
+    const char*     start;
+    const char*     stopAt;
+    const char*     stoppedAt;      // Where the next token (the first one for the next chunk) starts
+    ScanPosition    stoppedPosition;
+    token_vector    tokens;
+    bool            scanned;
+};
+
+// A token, or position, from a speculative scan moved to where the exact scan put syncToken.
+// syncLine and syncCharacter are where syncToken was in the speculative scan.
+static inline void moveScanPosition(long& lineNumber, long& characterNumber, long syncLine, long syncCharacter, const ScanPosition& exact)
+{
+    if (lineNumber == syncLine)
+    {
+        characterNumber += exact.characterNumber - syncCharacter;
+    }
+    lineNumber += exact.lineNumber - syncLine;
+}
+
+// Find the token starting at tokenStart.  The chunk tokens are in source order.
+static Token* findTokenStartingAt(token_vector& chunkTokens, const char* tokenStart)
+{
+    auto found = lower_bound(chunkTokens.begin(), chunkTokens.end(), tokenStart,
+        [](const Token& token, const char* start) { return token.tokenString.data() < start; });
+
+    return (found != chunkTokens.end() && found->tokenString.data() == tokenStart) ? &*found : NULL;
+}
+
+/*
+* The source is split into chunks at line starts.  Every chunk but the first is scanned speculatively, in
+* parallel, from line 1 character 1 - as if nothing came before it.  That guess is wrong when the chunk
+* starts inside a multi-line token (a string or a * comment), but the scan is deterministic from any given
+* token start, so once the speculative scan and the exact scan start a token at the same place they agree
+* from there on.
+*
+* Stitching the chunks together in order:
+*   The exact scan knows where the first token of the next chunk starts (the previous chunk ran its last
+*   token to completion).  If the speculative scan also started a token there, the rest of the chunk is
+*   used as is with the line and character numbers moved.  If not the exact scan takes one token at a time
+*   until it reaches a token start the speculative scan found, or it runs past the chunk.
+*/
+void Tokenizer::internalTokenizeParallel(ReadFileData* source, unsigned threadCount, WorkerPool* pool)
+{
+    const char* runner = source->start();
+    const char* end = source->end();
+    skipByteOrderMark(runner, end);
+
+    if (NULL == pool) pool = &WorkerPool::shared();
+
+    unsigned threads = (0 == threadCount) ? pool->size() + 1 : threadCount;
+    size_t chunkSize = max<size_t>(parallelChunkSize, 1);
+    size_t chunkCount = min<size_t>((size_t)threads * 4, (size_t)(end - runner) / chunkSize);
+
+    if (threads < 2 || chunkCount < 2)
+    {
+        internalTokenize(tokens, source);
+        return;
+    }
+
+    // Split just after a '\n' near each nominal boundary - a new line is the most likely place for a token to start.
+    vector<TokenizeChunk> chunks;
+    chunks.reserve(chunkCount);
+
+    size_t nominalSize = (end - runner) / chunkCount;
+    const char* chunkStart = runner;
+    while (chunkStart < end)
+    {
+        const char* stopAt = end;
+        if (chunks.size() + 1 < chunkCount && (size_t)(end - chunkStart) > nominalSize)
+        {
+            stopAt = scanKernels->findCharacter(chunkStart + nominalSize, end, '\n');
+            if (stopAt < end) stopAt++;
+        }
+
+        TokenizeChunk& chunk = chunks.emplace_back();
+        chunk.start = chunkStart;
+        chunk.stopAt = stopAt;
+        chunk.stoppedAt = end;
+        chunk.stoppedPosition = firstPosition();
+        chunk.scanned = false;
+
+        chunkStart = stopAt;
+    }
+
+    // With lazyPositions all the positions stay at 0, so moving them does nothing.
+    auto chunkScanner = activeScanner();
+
+    // The first chunk is exact, the others are speculative.
+    pool->parallelFor(chunks.size(), [this, &chunks, end, chunkScanner](size_t index) {
+            TokenizeChunk& chunk = chunks[index];
+
+            chunk.tokens.reserve((chunk.stopAt - chunk.start) / 4);
+
+            const char* chunkRunner = chunk.start;
+            chunk.scanned = (*chunkScanner)(*this, chunk.tokens, chunkRunner, chunk.stopAt, end, chunk.stoppedPosition);
+            chunk.stoppedAt = chunkRunner;
+        }, threads);
+
+    // No whitespace matcher - the same as internalTokenize, no tokens.
+    if (!chunks.front().scanned) return;
+
+    size_t tokenCount = 0;
+    for (auto& chunk : chunks) tokenCount += chunk.tokens.size();
+    size_t first = tokens.size();
+    tokens.reserve(first + tokenCount + 1);
+
+    tokens.insert(tokens.end(), chunks.front().tokens.begin(), chunks.front().tokens.end());
+
+    const char* exactRunner = chunks.front().stoppedAt;
+    ScanPosition exact = chunks.front().stoppedPosition;
+
+    for (size_t index = 1; index < chunks.size(); index++)
+    {
+        TokenizeChunk& chunk = chunks[index];
+
+        // The next token start, with the exact scan taking single tokens until the speculative scan agrees.
+        Token* sync = NULL;
+        while (exactRunner < chunk.stopAt && NULL == (sync = findTokenStartingAt(chunk.tokens, exactRunner)))
+        {
+            (*chunkScanner)(*this, tokens, exactRunner, exactRunner + 1, end, exact);
+        }
+
+        // Covered by a token from an earlier chunk, or the exact scan has already gone past it.
+        if (NULL == sync) continue;
+
+        long syncLine = sync->startingLine;
+        long syncCharacter = sync->startingCharacter;
+
+        for (Token* token = sync; token != chunk.tokens.data() + chunk.tokens.size(); ++token)
+        {
+            Token& moved = tokens.emplace_back(*token);
+            moveScanPosition(moved.startingLine, moved.startingCharacter, syncLine, syncCharacter, exact);
+        }
+
+        ScanPosition stoppedPosition = chunk.stoppedPosition;
+        moveScanPosition(stoppedPosition.lineNumber, stoppedPosition.characterNumber, syncLine, syncCharacter, exact);
+
+        exact = stoppedPosition;
+        exactRunner = chunk.stoppedAt;
+
+        // Not needed any more - give the memory back as we go.
+        token_vector().swap(chunk.tokens);
+    }
+
+    tokens.emplace_back(exact.lineNumber, exact.characterNumber, Token::endOfInput).tokenString = string_view(end, 0);
+
+    checkEncoding(tokens, first, source);
+    separateTrivia(tokens, first, runner);
+
+    // Interning the speculative tokens could add atoms for text that is really inside a string, so intern the final tokens.
+    // The numbers are the same - each slice gets a table of its own, and they are added in order.
+    if (NULL != atoms || NULL != numericValues)
+    {
+        size_t sliceSize = (tokens.size() - first + chunks.size() - 1) / chunks.size();
+        vector<NumericValues> sliceNumbers((NULL != numericValues) ? chunks.size() : 0);
 
-            tokens.emplace_back(lineNumber, characterNumber);
+        pool->parallelFor(chunks.size(), [this, first, sliceSize, &sliceNumbers](size_t index) {
+                internIdentifiers(tokens, first + index * sliceSize, first + (index + 1) * sliceSize);
+                if (!sliceNumbers.empty()) sliceNumbers[index].record(tokens, first + index * sliceSize, first + (index + 1) * sliceSize);
+            }, threads);
 
-            info.clear();
+        for (auto& slice : sliceNumbers) numericValues->append(slice);
+    }
+}
+
+
+void Tokenizer::tokenize(istream& input)
+{
+    auto readData = newSourceData();
+
+    readData->readInFile(input);
+    internalTokenize(tokens, readData);
+}
+
+// Matchers look at most a few bytes past what they match.  A token that ends closer than this to
+// some change in the source (the end of a stream chunk, an edit) could be different after it.
+static const size_t matcherLookahead = 16;
+
+bool Tokenizer::isUnterminated(const Token& token)
+{
+    // A failed StartEndMatcher - a string or * comment without its closing character.  It looked at everything
+    // up to the end of the source, so a closing character anywhere after it could make it match.
+    // The other matchers only fail on what is close to the start of the token.
+    if (Token::badPunctuation != token.typeFlags || token.tokenString.empty()) return false;
+
+    TokenMatching* match = grammar->dispatchTable[(unsigned char)token.tokenString.front()];
+    return NULL != match && &StartEndMatcher == match->tokenMatcher;
+}
+
+/*
+* Scan everything read so far, but only pass on the tokens that the rest of the stream cannot change.
+* The tokens from the first one that might not be complete are scanned again with the next chunk:
+*   - Tokens ending within matcherLookahead of the end of the data.
+*   - An unterminated string or comment, see isUnterminated.
+* When nothing can be passed on the read size doubles, so a long token is not rescanned for every chunk.
+*/
+
+void Tokenizer::tokenizeStream(istream& input, const function<void(token_vector& chunkTokens)>& tokensReady, size_t chunkSize)
+{
+    ReadFileData readData;
+    token_vector chunkTokens;
+    ScanPosition position;
+
+    chunkSize = max<size_t>(chunkSize, matcherLookahead * 4);
+    size_t readSize = chunkSize;
+
+    if (NULL != stringLiterals) stringLiterals->clear();
+    const char* runner = readData.readNextChunk(input, NULL, readSize);
+    skipByteOrderMark(runner, readData.end());
+
+    while (true)
+    {
+        const char* end = readData.end();
+        bool isLastChunk = !input;
+
+        ScanPosition chunkPosition = position;
+        const char* chunkRunner = runner;
+        if (!(*grammar->scanner)(*this, chunkTokens, chunkRunner, end, end, chunkPosition)) return;
+
+        if (isLastChunk)
+        {
+            chunkTokens.emplace_back(chunkPosition.lineNumber, chunkPosition.characterNumber, Token::endOfInput);
+            internIdentifiers(chunkTokens);
+            tokensReady(chunkTokens);
+            return;
+        }
 
-            auto match = tokenReadingMap.find(toLookup);
-            if (match != tokenReadingMap.end())
+        // The tokens that more input cannot change
+        size_t readyCount = 0;
+        for (; readyCount < chunkTokens.size(); readyCount++)
+        {
+            Token& token = chunkTokens[readyCount];
+            const char* tokenStart = token.tokenString.data();
+
+            if (tokenStart + token.tokenString.size() + matcherLookahead > end || isUnterminated(token)) break;
+        }
+
+        if (readyCount < chunkTokens.size())
+        {
+            // Rescan from the first token that is not ready
+            Token& notReady = chunkTokens[readyCount];
+            runner = notReady.tokenString.data();
+            position = ScanPosition(notReady.startingLine, notReady.startingCharacter);
+
+            chunkTokens.resize(readyCount);
+        }
+        else
+        {
+            // Only whitespace after the last token, that can just continue in the next chunk.
+            runner = chunkRunner;
+            position = chunkPosition;
+        }
+
+        if (0 < readyCount)
+        {
+            internIdentifiers(chunkTokens);
+            tokensReady(chunkTokens);
+            readSize = chunkSize;
+        }
+        else
+        {
+            readSize *= 2;
+        }
+        chunkTokens.clear();
+
+        if (NULL != stringLiterals) stringLiterals->clear();
+        runner = readData.readNextChunk(input, runner, readSize);
+    }
+}
+
+void Tokenizer::tokenize(boost::filesystem::path& filePath)
+{
+    auto readData = newSourceData();
+
+    readData->readInFile(filePath);
+    cachedTokenize(tokens, readData);
+}
+
+void Tokenizer::tokenize(string_view stringBuffer)
+{
+    auto readData = newSourceData();
+
+    readData->useExistingBuffer(stringBuffer.data(), stringBuffer.size());
+    internalTokenize(tokens, readData);
+}
+
+
+void Tokenizer::tokenizeParallel(boost::filesystem::path& filePath, unsigned threadCount, WorkerPool* pool)
+{
+    auto readData = newSourceData();
+
+    readData->readInFile(filePath);
+    internalTokenizeParallel(readData, threadCount, pool);
+}
+
+void Tokenizer::tokenizeParallel(string_view stringBuffer, unsigned threadCount, WorkerPool* pool)
+{
+    auto readData = newSourceData();
+
+    readData->useExistingBuffer(stringBuffer.data(), stringBuffer.size());
+    internalTokenizeParallel(readData, threadCount, pool);
+}
+
+/*
+* The scan restarts at the first token the edit could change:
+*   - the last token starting before the edit, and any before it that end within matcherLookahead of the edit,
+*     or start in the same run of non-whitespace.
+*   - an unterminated string or comment before that - the edit could add the closing character.
+* After the edit the text is the same as before, and scanning is deterministic from any token start.  So once a new
+* token starts where an old token (moved by the edit) started, the rest of the old tokens are still right.
+*/
+pair<size_t, size_t> Tokenizer::retokenize(token_vector& toUpdate, string_view oldSource, string_view newSource, const TokenEdit& edit)
+{
+    const char* oldStart = oldSource.data();
+    const char* newStart = newSource.data();
+    const char* newEnd = newStart + newSource.size();
+
+    ptrdiff_t shift = (ptrdiff_t)edit.insertedText.size() - (ptrdiff_t)edit.removedLength;
+    size_t newEditEnd = edit.offset + edit.insertedText.size();
+
+    auto oldOffset = [oldStart](const Token& token) { return (size_t)(token.tokenString.data() - oldStart); };
+
+    // The last token starting before the edit, then back over the tokens the edit could change.
+    size_t restart = lower_bound(toUpdate.begin(), toUpdate.end(), edit.offset,
+        [&oldOffset](const Token& token, size_t offset) { return oldOffset(token) < offset; }) - toUpdate.begin();
+    if (0 < restart) restart--;
+
+    // The start of the run of non-whitespace before the edit.  A failed match in it (like a '-' in front of a bad number)
+    // looked up to the first character it could not use, which could be at the edit.  The source before the edit is the
+    // same in newSource.
+    const char* wordStart = newStart + edit.offset;
+    while (newStart < wordStart && !isSpaceChar(*(wordStart - 1))) wordStart--;
+    size_t wordOffset = wordStart - newStart;
+
+    auto couldChange = [&](const Token& token) {
+        return wordOffset <= oldOffset(token) || edit.offset <= oldOffset(token) + token.tokenString.size() + matcherLookahead;
+    };
+
+    while (0 < restart && couldChange(toUpdate[restart - 1])) restart--;
+
+    for (size_t i = 0; i < restart; i++)
+    {
+        if (isUnterminated(toUpdate[i]))
+        {
+            restart = i;
+            break;
+        }
+    }
+
+    // A ReadFileData for oldSource now uses newSource.  The encoding is checked with it, or with one just for newSource
+    // when the tokens are not from this Tokenizer's sources.
+    ReadFileData* source = NULL;
+    for (auto fileData : sourceFileData)
+    {
+        if (oldStart != fileData->start()) continue;
+
+        fileData->useExistingBuffer(newStart, newSource.size());
+        source = fileData;
+    }
+    if (NULL != stringLiterals) stringLiterals->clear();
+
+    ReadFileData editedSource;
+    if (NULL == source)
+    {
+        editedSource.useExistingBuffer(newStart, newSource.size());
+        source = &editedSource;
+    }
+
+    // The scan counts bytes, the tokens could have their characters in code points.
+    bool columnsInCodePoints = codePointColumns && !lazyPositions;
+
+    auto scanOneToken = activeScanner();
+
+    const char* runner = newStart;
+    ScanPosition position = firstPosition();
+    if (0 < restart && restart < toUpdate.size())
+    {
+        runner = newStart + oldOffset(toUpdate[restart]);
+        position = ScanPosition(toUpdate[restart].startingLine, toUpdate[restart].startingCharacter);
+
+        // The source is the same up to the edit, so the line start is found in newSource.
+        if (columnsInCodePoints)
+        {
+            const char* lineStart = runner;
+            while (newStart < lineStart && '\n' != *(lineStart - 1)) lineStart--;
+            if (newStart == lineStart) skipByteOrderMark(lineStart, runner);
+
+            position.characterNumber = (long)(runner - lineStart) + 1;
+        }
+    }
+    else
+    {
+        restart = 0;
+        skipByteOrderMark(runner, newEnd);
+    }
+
+    // Scan a token at a time until a new token starts where an old one did.
+    token_vector scanned;
+    size_t sync = toUpdate.size();
+
+    bool canScan = (*scanOneToken)(*this, scanned, runner, runner, newEnd, position);   // Just the whitespace
+    while (canScan && runner < newEnd)
+    {
+        if ((size_t)(runner - newStart) >= newEditEnd)
+        {
+            size_t syncOffset = (size_t)(runner - newStart - shift);
+            auto found = lower_bound(toUpdate.begin() + restart, toUpdate.end(), syncOffset,
+                [&oldOffset](const Token& token, size_t offset) { return oldOffset(token) < offset; });
+
+            if (found != toUpdate.end() && oldOffset(*found) == syncOffset && Token::endOfInput != found->typeFlags)
             {
-                if (NULL != *match->second->tokenMatcher)
-                {
-                    info = (*match->second->tokenMatcher)(runner, end, match->second->matchOrSpecial);
-                }
-                else
-                {
-                    // Single character match - matchOrSpecial goes too the inf.id
-                    info.id = match->second->matchOrSpecial;
-                    info.length = 1;
-                    info.chars = 1;
-                }
+                sync = found - toUpdate.begin();
+                break;
             }
+        }
 
-            Token& token = tokens.back();
-            if (0 < info.length && 0 != info.id)
-            {
-                token.tokenString = string_view(runner, info.length);
-                (*idToTokenType)(info, token);
+        (*scanOneToken)(*this, scanned, runner, runner + 1, newEnd, position);
+    }
 
-                runner += info.length;
-                lineNumber += info.lines;
-                characterNumber += info.chars;
+    bool synced = sync < toUpdate.size();
+    long syncLine = synced ? toUpdate[sync].startingLine : 0;
+    long syncCharacter = synced ? toUpdate[sync].startingCharacter : 0;
+
+    // The old tokens are moved by the characters between them and the sync token - the same text as before.
+    if (synced && columnsInCodePoints) position.characterNumber = source->codePointColumn(runner, position.characterNumber);
+
+    if (synced)
+    {
+        // Move the rest of the old tokens
+
+        for (size_t i = sync; i < toUpdate.size(); i++)
+        {
+            Token& token = toUpdate[i];
+            token.tokenString = string_view(newStart + oldOffset(token) + shift, token.tokenString.size());
+            moveScanPosition(token.startingLine, token.startingCharacter, syncLine, syncCharacter, position);
+        }
+    }
+    else if (canScan)
+    {
+        scanned.emplace_back(position.lineNumber, position.characterNumber, Token::endOfInput).tokenString = string_view(newEnd, 0);
+    }
+
+    // The tokens before the edit are the same, they just might be in a different buffer.
+    if (newStart != oldStart)
+    {
+        for (size_t i = 0; i < restart; i++)
+        {
+            Token& token = toUpdate[i];
+            token.tokenString = string_view(newStart + oldOffset(token), token.tokenString.size());
+        }
+    }
+
+    // The same as finishTokens - the encoding is checked before the identifiers are interned or the comments taken out.
+    checkEncoding(scanned, 0, source);
+
+    // The comments are kept out of the tokens the same way as by the tokenize - see separateTrivia.
+    if (dropTrivia)
+    {
+        TokenTrivia::drop(scanned);
+    }
+    else if (NULL != trivia && &toUpdate == &tokens)
+    {
+        // The trivia attached to the tokens that were scanned again is replaced by the trivia of the scan.  The scanned
+        // range runs from the restart token (from the source start for 0) up to the sync token.
+        TokenTrivia scannedTrivia(trivia->keepWhitespace);
+        if (synced) scanned.push_back(toUpdate[sync]);     // So the whitespace before the sync token is found
+        if (!scanned.empty()) scannedTrivia.separate(scanned, 0, (0 == restart) ? newStart : scanned.front().tokenString.data());
+        if (synced) scanned.pop_back();
+
+        vector<TriviaEntry>& entries = trivia->entries;
+        auto byIndex = [](const TriviaEntry& entry, size_t index) { return entry.tokenIndex < index; };
+        auto from = lower_bound(entries.begin(), entries.end(), (0 == restart) ? 0 : restart + 1, byIndex);
+        auto to = synced ? lower_bound(from, entries.end(), sync + 1, byIndex) : entries.end();
+
+        // The old trivia moves with the old tokens - into newSource, and after the edit to the new lines and indexes.
+        for (auto entry = entries.begin(); entry != from; ++entry)
+        {
+            Token& token = entry->token;
+            token.tokenString = string_view(newStart + oldOffset(token), token.tokenString.size());
+        }
+
+        ptrdiff_t indexShift = (ptrdiff_t)scanned.size() - (ptrdiff_t)(sync - restart);
+        for (auto entry = to; entry != entries.end(); ++entry)
+        {
+            Token& token = entry->token;
+            token.tokenString = string_view(newStart + oldOffset(token) + shift, token.tokenString.size());
+            if (Token::whitespace != token.typeFlags) moveScanPosition(token.startingLine, token.startingCharacter, syncLine, syncCharacter, position);
+            entry->tokenIndex = (uint32_t)(entry->tokenIndex + indexShift);
+        }
+
+        for (auto& entry : scannedTrivia.entries) entry.tokenIndex += (uint32_t)restart;
+
+        size_t at = from - entries.begin();
+        entries.erase(from, to);
+        entries.insert(entries.begin() + at, scannedTrivia.entries.begin(), scannedTrivia.entries.end());
+    }
+
+    internIdentifiers(scanned);
+
+    // Splice in the new tokens - only the tail moves, and only if the number of tokens changed.
+    size_t replaced = sync - restart;
+    size_t overwrite = min(replaced, scanned.size());
+    copy(scanned.begin(), scanned.begin() + overwrite, toUpdate.begin() + restart);
+
+    if (overwrite < replaced) toUpdate.erase(toUpdate.begin() + restart + overwrite, toUpdate.begin() + sync);
+    else toUpdate.insert(toUpdate.begin() + restart + overwrite, scanned.begin() + overwrite, scanned.end());
+
+    if (NULL != numericValues && &toUpdate == &tokens) numericValues->replace(toUpdate, restart, sync, restart + scanned.size());
+
+    return make_pair(restart, restart + scanned.size());
+}
+
+vector<TokenizedFile> Tokenizer::tokenizeAll(span<const boost::filesystem::path> filePaths, unsigned threadCount, WorkerPool* pool)
+{
+    vector<TokenizedFile> results(filePaths.size());
+
+    if (NULL == pool) pool = &WorkerPool::shared();
+
+    // The arena is not thread safe, so the ReadFileData objects are all made here.
+    vector<ReadFileData*> fileData(filePaths.size());
+    for (size_t i = 0; i < results.size(); i++) fileData[i] = results[i].fileData = newSourceData();
+
+    // Only the scanner reads the Tokenizer, so the workers can all share it.  Each file has its own token_vector and ReadFileData.
+    // Each file is tokenized as soon as it has been read, while the reads of the others are still going.
+    FileIngestor ingestor(pool);
+    ingestor.readAll(filePaths, fileData, [this, &filePaths, &results](size_t index, const string& error) {
+            TokenizedFile& result = results[index];
+            result.filePath = filePaths[index];
+
+            if (!error.empty())
+            {
+                result.error = error;
+                return;
             }
-            else if (is_punct)
+
+            try
             {
-                // Bad / unsupported punctuation
-                token.typeFlags = Token::badPunctuation;
-                token.tokenString = string_view(runner++, 1);
-                characterNumber++;
+                cachedTokenize(result.tokens, result.fileData);
             }
-            else
+            catch (exception& ex)
             {
-                // Not matched - make it a bad token from the current location to the next whitespace
-                // This should not happen unless the char = 0 map entry was not set.
-                failTokenToNextWhitespace(token, Token::badUnknown, characterNumber, lineNumber, runner, end);
+                result.error = ex.what();
+                result.tokens.clear();
             }
-        }
+        }, threadCount);
+
+    return results;
+}
 
-        tokens.emplace_back(lineNumber, characterNumber, Token::endOfInput);
 
+ReadFileData* Tokenizer::sourceDataFor(const char* at, size_t length)
+{
+    // Newest first - a caller's buffer can be tokenized again, longer, before a cleanup.
+    for (auto fileData = sourceFileData.rbegin(); fileData != sourceFileData.rend(); ++fileData)
+    {
+        if ((*fileData)->contains(at) && (*fileData)->contains(at + length)) return *fileData;
     }
-}
 
+    return NULL;
+}
 
-void Tokenizer::tokenize(istream& input)
+bool Tokenizer::resolvePosition(Token& token)
 {
-    auto readData = new ReadFileData();
-    sourceFileData.push_back(readData);
+    ReadFileData* fileData = sourceDataFor(token.tokenString.data(), token.tokenString.size());
+    if (NULL == fileData) return false;
 
-    const char* start = readData->readInFile(input);
-    internalTokenize(start, readData->end());
+    fileData->positionOf(token.tokenString.data(), token.startingLine, token.startingCharacter);
+    if (codePointColumns) token.startingCharacter = fileData->codePointColumn(token.tokenString.data(), token.startingCharacter);
+    return true;
 }
 
-void Tokenizer::tokenize(boost::filesystem::path& filePath)
+void Tokenizer::resolvePositions(token_vector& toResolve)
 {
-    auto readData = new ReadFileData();
-    sourceFileData.push_back(readData);
+    ReadFileData* fileData = NULL;
+
+    for (auto& token : toResolve)
+    {
+        const char* tokenStart = token.tokenString.data();
+        const char* tokenEnd = tokenStart + token.tokenString.size();
 
-    const char* start = readData->readInFile(filePath);
-    internalTokenize(start, readData->end());
+        // The tokens are usually all from the same source
+        if (NULL == fileData || !fileData->contains(tokenStart) || !fileData->contains(tokenEnd)) fileData = sourceDataFor(tokenStart, token.tokenString.size());
+
+        if (NULL == fileData) continue;
+
+        fileData->positionOf(tokenStart, token.startingLine, token.startingCharacter);
+        if (codePointColumns) token.startingCharacter = fileData->codePointColumn(tokenStart, token.startingCharacter);
+    }
 }
 
-void Tokenizer::tokenize(string_view stringBuffer)
+
+TokenizerStats Tokenizer::getStatistics()
 {
-    auto readData = new ReadFileData();
-    sourceFileData.push_back(readData);
+    lock_guard<mutex> lock(statisticsLock);
+    return (NULL != statistics) ? *statistics : TokenizerStats();
+}
 
-    const char* start = readData->useExistingBuffer(stringBuffer.data(), stringBuffer.size());
-    internalTokenize(start, readData->end());
+void Tokenizer::clearStatistics()
+{
+    lock_guard<mutex> lock(statisticsLock);
+    if (NULL != statistics) statistics->clear();
 }
 
+void Tokenizer::addStatistics(const TokenizerStats& scanStatistics)
+{
+    lock_guard<mutex> lock(statisticsLock);
+    if (NULL == statistics) statistics = make_unique<TokenizerStats>();
+    statistics->add(scanStatistics);
+}
 
 void Tokenizer::cleanup()
 {
     tokens.clear();
+    if (NULL != stringLiterals) stringLiterals->clear();
+    if (NULL != numericValues) numericValues->clear();
+    if (NULL != trivia) trivia->clear();
 
-    for (auto it = sourceFileData.begin(); it != sourceFileData.end(); ++it) delete *it;
     sourceFileData.clear();
+    spareFileData.clear();
+    arena.reset();
+}
+
+void Tokenizer::reset()
+{
+    tokens.clear();
+    if (NULL != stringLiterals) stringLiterals->clear();
+    if (NULL != numericValues) numericValues->clear();
+    if (NULL != trivia) trivia->clear();
+
+    for (auto fileData : sourceFileData)
+    {
+        fileData->release();
+        spareFileData.push_back(fileData);
+    }
+    sourceFileData.clear();
+}
+
+Tokenizer::~Tokenizer()
+{
+    cleanup();
+}
+
+TokenizerGrammar::~TokenizerGrammar()
+{
+    for (auto& entry : tokenReadingMap) delete entry.second;
+    delete &tokenReadingMap;
 }
@@ -34,6 +34,7 @@ public:
         functionReturn,
         selfCall,
         compilerFlag,
+        whitespace,         // Only in a TokenTrivia with keepWhitespace
 
 
         sectionSize = 64,
@@ -52,7 +53,8 @@ public:
         badString,
         badNumber,
         badPunctuation,
-        badUnknown
+        badUnknown,
+        badEncoding         // Not utf8 - only with Tokenizer::validateUtf8
     };
 
     enum ParsingFlags
@@ -97,6 +99,9 @@ public:
 
 
     bool            hasScope;
+    bool            hasEscape;          // A string with a \ escape in it - StringLiterals only copies these
+    uint16_t        keywordId;          // Which keyword it is, from the grammar's KeywordTable - 0 for the other tokens
+    uint32_t        atom;               // The AtomTable id of an identifier when Tokenizer::atoms is set, otherwise AtomTable::noAtom
     long            startingLine;
     long            startingCharacter;
     string_view     tokenString;
@@ -114,7 +119,14 @@ public:
 
     inline std::string errorDisplay()
     {
+#ifdef __cpp_lib_format
         return std::format("\"{:20}\"\nLine: {} Offset: {}", tokenString, startingLine, startingCharacter);
+#else
+        // No <format> in the library (GCC before 13)
+        std::ostringstream display;
+        display << "\"" << std::left << std::setw(20) << tokenString << "\"\nLine: " << startingLine << " Offset: " << startingCharacter;
+        return display.str();
+#endif
     }
 
     ostream& OutputTypeFlag(ostream& output);
@@ -124,6 +136,58 @@ public:
     bool isBlock();
 };
 
+// The names in Token::tokenTypeNames, as a table indexed by type - no map lookups when writing tokens out.
+// The packageName flag is not in the table, it is added to the identifier types.
+constexpr size_t tokenTypeNameCount = Token::failures + Token::sectionSize;
+
+constexpr array<string_view, tokenTypeNameCount> makeTokenTypeNames()
+{
+    array<string_view, tokenTypeNameCount> names{};
+
+    names[Token::notAFailure] = "notAFailure"sv;
+    names[Token::endOfInput] = "endOfInput"sv;
+    names[Token::unknownToken] = "unknownToken"sv;
+    names[Token::incomplete] = "incomplete"sv;
+    names[Token::comment] = "comment"sv;
+    names[Token::multiLineComment] = "multiLineComment"sv;
+    names[Token::identifier] = "identifier"sv;
+    names[Token::number] = "number"sv;
+    names[Token::hexNumber] = "hexNumber"sv;
+    names[Token::stringValue] = "stringValue"sv;
+    names[Token::assignment] = "assignment"sv;
+    names[Token::scope] = "scope"sv;
+    names[Token::member] = "member"sv;
+    names[Token::name] = "name"sv;
+    names[Token::keyword] = "keyword"sv;
+    names[Token::functionReturn] = "functionReturn"sv;
+    names[Token::selfCall] = "selfCall"sv;
+    names[Token::compilerFlag] = "compilerFlag"sv;
+    names[Token::whitespace] = "whitespace"sv;
+    names[Token::block] = "block"sv;
+    names[Token::block_start] = "block_start"sv;
+    names[Token::block_end] = "block_end"sv;
+    names[Token::params_start] = "params_start"sv;
+    names[Token::params_end] = "params_end"sv;
+    names[Token::prototype_start] = "prototype_start"sv;
+    names[Token::prototype_end] = "prototype_end"sv;
+    names[Token::failures] = "failures"sv;
+    names[Token::badString] = "badString"sv;
+    names[Token::badNumber] = "badNumber"sv;
+    names[Token::badPunctuation] = "badPunctuation"sv;
+    names[Token::badUnknown] = "badUnknown"sv;
+    names[Token::badEncoding] = "badEncoding"sv;
+
+    return names;
+}
+
+inline constexpr array<string_view, tokenTypeNameCount> tokenTypeNameTable = makeTokenTypeNames();
+
+// The name of a type without the packageName flag, empty if it has none.
+constexpr string_view tokenTypeName(long tokenType)
+{
+    return (0 <= tokenType && (size_t)tokenType < tokenTypeNameCount) ? tokenTypeNameTable[tokenType] : string_view();
+}
+
 void TokenFlagToString(string& toAppendFlags, long tokenTypeFlags);
 
 class EXPORT TokenMatching
@@ -164,37 +228,293 @@ public:
     token_vector();
 };
 
-class EXPORT Tokenizer {
+void failTokenToNextWhitespace(Token& token, long faiureCode, long& characterNumber, long lineNumber, const char*& runner, const char* end);
+
+// Skip a UTF8 BOM if runner is at one
+void skipByteOrderMark(const char*& runner, const char* end);
+
+// The line and character a scan starts at, and where it stopped.
+struct ScanPosition
+{
+    long    lineNumber;
+    long    characterNumber;
+
+    ScanPosition(long inLineNumber = 1, long inCharacterNumber = 1) :
+        lineNumber(inLineNumber),
+        characterNumber(inCharacterNumber)
+    {}
+};
+
+class WorkerPool;
+class AtomTable;
+class TokenCache;
+class NumericValues;
+class StringLiterals;
+class TokenTrivia;
+
+// An edit to a source: the removedLength bytes at offset were replaced by insertedText.
+struct EXPORT TokenEdit
+{
+    size_t          offset;
+    size_t          removedLength;
+    string_view     insertedText;
+};
+
+// The tokens for one file from Tokenizer::tokenizeAll.
+struct EXPORT TokenizedFile
+{
+    boost::filesystem::path filePath;
+    token_vector    tokens;
+    ReadFileData*   fileData;   // Owned by the Tokenizer, freed by cleanup - the tokenStrings point into it
+    string          error;      // Why the file could not be tokenized, empty when it was
+};
+
+// The scanning loop - see GrammarScanning.h
+// Adds the tokens that start before stopAt to tokens.  Returns false if the grammar cannot scan (no whitespace matcher).
+typedef bool (*TokenScanner)(Tokenizer& tokenizer, token_vector& tokens, const char*& runner, const char* stopAt, const char* end, ScanPosition& position);
+
+/*
+* The rules of a language - what the Tokenizer scans with.
+*
+* Set a grammar up (buildDispatchTable, useStaticGrammar), then share it as a shared_ptr<const TokenizerGrammar>.
+* Scanning only reads it, so any number of Tokenizers on any number of threads can use one grammar without locks.
+* Each Tokenizer is the state for one thread - its tokens and sources.
+*/
+class EXPORT TokenizerGrammar
+{
+    friend class RuntimeGrammar;
+    friend class Tokenizer;
+    friend class TokenCursor;
+
 protected:
-    // Find all the tokens
-    void internalTokenize(const char*& runner, const char* end);
+    TokenScanner    scanner;
 
-    list<ReadFileData*> sourceFileData;
+    // The same loop without the line and character bookkeeping, for Tokenizer::lazyPositions.
+    TokenScanner    offsetScanner;
+
+    // The tokenReadingMap flattened to one entry per byte.  Digits are already mapped to the '0' entry,
+    // and identifier characters to the 'a' entry, so a single index finds the TokenMatching.
+    TokenMatching*  dispatchTable[256];
+    TokenMatching*  whitespaceMatching;
 
 public:
     void (*idToTokenType)(const MatchInfo& info, Token& token);
 
-    // Collections
     map<char, TokenMatching*>& tokenReadingMap;
 
+    // The grammar owns inTokenReadingMap and its TokenMatchings.
+    TokenizerGrammar(
+        map<char, TokenMatching*>* inTokenReadingMap,
+        void (*inIdToTokenType)(const MatchInfo&, Token&)
+    ) :
+        idToTokenType(inIdToTokenType),
+        tokenReadingMap(*inTokenReadingMap)
+    {
+        buildDispatchTable();
+    }
+
+    ~TokenizerGrammar();
+
+    TokenizerGrammar(const TokenizerGrammar&) = delete;
+    TokenizerGrammar& operator=(const TokenizerGrammar&) = delete;
+
+    // Rebuild dispatchTable - call this if tokenReadingMap is changed after construction.
+    // This also goes back to the runtime grammar if useStaticGrammar was called.
+    void buildDispatchTable();
+
+    // Scan with a compile time grammar (see GrammarScanning.h) instead of tokenReadingMap and idToTokenType.
+    // The grammar should match the tokenReadingMap, the map is still used for anything that looks up a TokenMatching.
+    template <class Grammar> void useStaticGrammar();
+};
+
+class EXPORT Tokenizer {
+    friend class RuntimeGrammar;
+    friend class TokenCursor;
+
+protected:
+    // Find all the tokens of source - scanSource, then finishTokens
+    void internalTokenize(token_vector& target, ReadFileData* source);
+    void scanSource(token_vector& target, const char*& runner, const char* end);
+
+    // The work done on the tokens of source from first on after the scan: the utf8 checks, atoms, trivia and numbers.
+    void finishTokens(token_vector& target, size_t first, ReadFileData* source);
+    void internalTokenizeParallel(ReadFileData* source, unsigned threadCount, WorkerPool* pool);
+
+    // internalTokenize, or the saved tokens from tokenCache for a file that has been tokenized before.
+    void cachedTokenize(token_vector& target, ReadFileData* source);
+
+    // Shared with the other Tokenizers using the same rules
+    shared_ptr<const TokenizerGrammar> grammar;
+
+    // grammar->scanner, or grammar->offsetScanner for lazyPositions
+    TokenScanner activeScanner() const { return lazyPositions ? grammar->offsetScanner : grammar->scanner; }
+
+    // Stamp the identifiers from first on with their atoms, if atoms is set
+    void internIdentifiers(token_vector& toIntern, size_t first = 0, size_t last = SIZE_MAX);
+
+    // Parse the numbers from first on into numericValues, if it is set and target is tokens - the indexes are into tokens.
+    void recordNumbers(token_vector& target, size_t first);
+
+    // validateUtf8 and codePointColumns for the tokens from first on, all from source.
+    void checkEncoding(token_vector& target, size_t first, ReadFileData* source);
+
+    // dropTrivia, or move the comments from first on into trivia if it is set and target is tokens.
+    void separateTrivia(token_vector& target, size_t first, const char* start);
+
+    // A string or comment without its closing character - see Tokenizer.cpp
+    bool isUnterminated(const Token& token);
+
+    // The newest ReadFileData with all of the length bytes at "at" in it, or NULL
+    ReadFileData* sourceDataFor(const char* at, size_t length = 0);
+
+    // Where a scan starts - lazyPositions scans leave the positions at 0.
+    ScanPosition firstPosition() const { return lazyPositions ? ScanPosition(0, 0) : ScanPosition(); }
+
+    // A ReadFileData for a new source, added to sourceFileData.  One kept by reset, or a new one in the arena.
+    ReadFileData* newSourceData();
+
+    // Make room for the tokens of sourceBytes more source, from the bytes per token of typical code.
+    static void reserveTokens(token_vector& target, size_t sourceBytes);
+
+    // The ReadFileData objects are made in the arena, cleanup destroys them all and keeps the memory.
+    TokenArena              arena;
+    vector<ReadFileData*>   sourceFileData;
+    vector<ReadFileData*>   spareFileData;      // Released by reset, for the next sources
+
+    token_vector            tokenStorage;
+
+    // Only made when TOKENIZER_STATS is defined, the scans of all the threads add to it.
+    unique_ptr<TokenizerStats>  statistics;
+    mutex                       statisticsLock;
+
+public:
+    // Collections
+    const map<char, TokenMatching*>& tokenReadingMap;
+
     token_vector& tokens;
 
-    // Constructor
+    // The smallest chunk tokenizeParallel gives to a thread.
+    size_t parallelChunkSize;
+
+    // When set, identifiers (and package identifiers) are interned, and their tokens get the atom.
+    // The AtomTable is not owned by the Tokenizer, so it can be shared by all the Tokenizers of a build.
+    AtomTable* atoms;
+
+    // When set, tokenize(filePath) and tokenizeAll load the tokens of an unchanged file instead of scanning it,
+    // and save the tokens of the files they do scan.  Not owned, one TokenCache can be shared by all the Tokenizers.
+    TokenCache* tokenCache;
+
+    // When set, it is cleared whenever a source buffer could be reused for other text - by cleanup, reset, retokenize
+    // and each tokenizeStream chunk - so its values stay right for the tokens.  Not owned.  See StringLiterals.h.
+    StringLiterals* stringLiterals;
+
+    // Check each source is utf8 (ReadFileData::checkUtf8), and make the tokens with bad bytes in them badEncoding.
+    bool validateUtf8;
+
+    // Count startingCharacter in characters (code points) instead of bytes.  Only the tokens on lines with
+    // non-ASCII bytes before them change, an ASCII source costs one skipAscii pass.  resolvePosition(s) and retokenize
+    // count the same way.  Neither of these is done by TokenCursor or tokenizeStream.
+    bool codePointColumns;
+
+    // When set, the number tokens added to tokens get their values parsed into it, right after each scan.
+    // Not owned.  It is cleared with the tokens by cleanup and reset.  See NumericValues.h.
+    NumericValues* numericValues;
+
+    // When set, the comments (and whitespace, see TokenTrivia::keepWhitespace) are moved out of tokens into it,
+    // right after each scan - the tokens are just the ones a parser needs.  Not owned.  It is cleared with the
+    // tokens by cleanup and reset.  See TokenTrivia.h.
+    TokenTrivia* trivia;
+
+    // Take the comments out of the tokens and do not keep them - for a compile, where nothing needs them.
+    // This is for tokenizeAll and retokenize too, trivia is only for tokens.  tokenizeStream and TokenCursor always
+    // keep the comments in the tokens.
+    bool dropTrivia;
+
+    // Only record where the tokens are - startingLine and startingCharacter are 0 until resolvePosition(s) is called.
+    // The scan skips all of the line and character bookkeeping.  tokenizeStream always tracks the positions.
+    bool lazyPositions;
+
+    // A Tokenizer using a shared grammar.
+    Tokenizer(shared_ptr<const TokenizerGrammar> inGrammar) :
+        grammar(std::move(inGrammar)),
+        tokenReadingMap(grammar->tokenReadingMap),
+        tokens(tokenStorage),
+        parallelChunkSize(1024 * 1024),
+        atoms(NULL),
+        tokenCache(NULL),
+        stringLiterals(NULL),
+        validateUtf8(false),
+        codePointColumns(false),
+        numericValues(NULL),
+        trivia(NULL),
+        dropTrivia(false),
+        lazyPositions(false)
+    {
+    }
+
+    // A Tokenizer with a grammar of its own, the grammar owns inTokenReadingMap.
     Tokenizer(
         map<char, TokenMatching*>* inTokenReadingMap,
         void (*inIdToTokenType)(const MatchInfo&, Token&)
     ) :
-        idToTokenType(inIdToTokenType),
-        tokenReadingMap(*inTokenReadingMap),
-        tokens(*(new token_vector()))
-    {}
+        Tokenizer(make_shared<TokenizerGrammar>(inTokenReadingMap, inIdToTokenType))
+    {
+    }
+
+    ~Tokenizer();
+
+    Tokenizer(const Tokenizer&) = delete;
+    Tokenizer& operator=(const Tokenizer&) = delete;
+
+    const shared_ptr<const TokenizerGrammar>& getGrammar() const { return grammar; }
 
     void tokenize(istream& input);
     void tokenize(boost::filesystem::path& filePath);
     void tokenize(string_view stringBuffer);
 
-    // Cleanup
+    // Split the source into chunks and tokenize them on a WorkerPool.  The tokens are the same as tokenize.
+    // threadCount 0 uses all of the pool, pool NULL uses WorkerPool::shared().
+    // Sources smaller than two parallelChunkSize chunks are just tokenized on the calling thread.
+    void tokenizeParallel(boost::filesystem::path& filePath, unsigned threadCount = 0, WorkerPool* pool = NULL);
+    void tokenizeParallel(string_view stringBuffer, unsigned threadCount = 0, WorkerPool* pool = NULL);
+
+    // Tokenize input a chunk at a time, without reading all of it into memory.  Use this for pipes and other long streams.
+    // tokensReady gets the tokens as they are found, the last call ends with the endOfInput token.
+    // The tokenStrings are only valid during the call - the buffer is reused for the next chunk.
+    // The buffer is chunkSize plus the longest token (or a failed match like an unterminated string) at a chunk end.
+    void tokenizeStream(istream& input, const function<void(token_vector& chunkTokens)>& tokensReady, size_t chunkSize = 64 * 1024);
+
+    // Update the tokens of oldSource for an edit, instead of tokenizing all of newSource.  newSource is oldSource with the edit made.
+    // Only the tokens the edit could change are scanned again, until the new tokens line up with the old ones.  The tokens
+    // after that are moved into newSource, with their lines and characters shifted.  A ReadFileData for oldSource now uses newSource.
+    // When toUpdate is tokens, numericValues and trivia are updated too.  dropTrivia drops the scanned comments.
+    // Returns the first and (one past the) last index of the scanned tokens in toUpdate.
+    pair<size_t, size_t> retokenize(token_vector& toUpdate, string_view oldSource, string_view newSource, const TokenEdit& edit);
+
+    // Tokenize many files on a WorkerPool.  Each file gets its own tokens, and the results are in the filePaths order.
+    // The Tokenizer's tokens are not changed.  A file that cannot be read has its error set instead of throwing.
+    vector<TokenizedFile> tokenizeAll(span<const boost::filesystem::path> filePaths, unsigned threadCount = 0, WorkerPool* pool = NULL);
+
+    // Set startingLine and startingCharacter from the line index of the ReadFileData the token is in.
+    // Returns false if the token is not from this Tokenizer's sources.
+    // This builds the line index the first time, so it is not thread safe unless ReadFileData::buildLineIndex was called.
+    bool resolvePosition(Token& token);
+    void resolvePositions(token_vector& toResolve);
+
+    // What the scans since the last clearStatistics() did - empty unless built with TOKENIZER_STATS.
+    // The statistics are kept by cleanup and reset, so a pooled Tokenizer counts all of its requests.
+    TokenizerStats getStatistics();
+    void clearStatistics();
+
+    // For the scanning loop - adds one scan's counts.  Thread safe.
+    void addStatistics(const TokenizerStats& scanStatistics);
+
+    // Cleanup - drop the tokens and the sources.  The memory for them is kept for the next tokenize.
     void cleanup();
+
+    // Get ready for the next request - like cleanup, but the ReadFileData objects and their read buffers are kept
+    // too.  For a Tokenizer that handles many small requests, see TokenizerPool.
+    void reset();
 };
 
 #endif // TOKENIZER_H_INCLUDED
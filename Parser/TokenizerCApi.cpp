@@ -0,0 +1,183 @@
+#include "pch.h"
+#include "TokenizerCApi.h"
+
+struct SptTokenizer
+{
+    Tokenizer&                  tokenizer;
+    unique_ptr<TokenCursor>     cursor;
+    const char*                 source;
+    bool                        done;
+
+    string                      lastError;
+
+    // For sptNextOwnedBatch
+    vector<uint32_t>            offsets;
+    vector<uint32_t>            lengths;
+    vector<int32_t>             types;
+    vector<int32_t>             lines;
+    vector<int32_t>             characters;
+
+    SptTokenizer() : tokenizer(initShadowPromisesTokenizer()), source(NULL), done(true) {}
+    ~SptTokenizer() { cursor.reset(); delete &tokenizer; }
+
+    // Take up to maxCount tokens, giving each one to write(index, token).
+    template<typename Write>
+    size_t take(size_t maxCount, Write write)
+    {
+        size_t count = 0;
+        for (; count < maxCount && !done; count++)
+        {
+            write(count, cursor->current());
+            if (!cursor->next()) done = true;
+        }
+
+        return count;
+    }
+
+    uint32_t offsetOf(const Token& token) const { return (uint32_t)(token.tokenString.data() - source); }
+};
+
+extern "C" EXPORT uint32_t sptAbiVersion(void)
+{
+    return SPT_ABI_VERSION;
+}
+
+extern "C" EXPORT SptTokenizer* sptCreate(void)
+{
+    try
+    {
+        return new SptTokenizer();
+    }
+    catch (...)
+    {
+        return NULL;
+    }
+}
+
+extern "C" EXPORT void sptDestroy(SptTokenizer* tokenizer)
+{
+    delete tokenizer;
+}
+
+extern "C" EXPORT int sptBegin(SptTokenizer* tokenizer, const char* source, size_t sourceLength, uint32_t flags)
+{
+    if (NULL == tokenizer) return SPT_ERROR;
+
+    tokenizer->cursor.reset();
+    tokenizer->done = true;
+    tokenizer->lastError.clear();
+
+    if (sourceLength > UINT32_MAX)
+    {
+        tokenizer->lastError = "The source is over 4GB";
+        return SPT_TOO_LARGE;
+    }
+    if (NULL == source && 0 < sourceLength)
+    {
+        tokenizer->lastError = "No source";
+        return SPT_ERROR;
+    }
+
+    try
+    {
+        // An empty source still needs an address for the endOfInput token
+        if (NULL == source) source = "";
+
+        tokenizer->source = source;
+        tokenizer->tokenizer.lazyPositions = 0 != (flags & SPT_LAZY_POSITIONS);
+        tokenizer->cursor = make_unique<TokenCursor>(tokenizer->tokenizer, string_view(source, sourceLength), 256);
+        tokenizer->done = false;
+    }
+    catch (exception& ex)
+    {
+        tokenizer->lastError = ex.what();
+        return SPT_ERROR;
+    }
+
+    return SPT_OK;
+}
+
+extern "C" EXPORT size_t sptNextBatch(SptTokenizer* tokenizer, const SptTokenColumns* columns)
+{
+    if (NULL == tokenizer) return 0;
+    tokenizer->lastError.clear();
+
+    if (NULL == columns || NULL == columns->offsets || NULL == columns->lengths || NULL == columns->types)
+    {
+        tokenizer->lastError = "The offsets, lengths and types are needed";
+        return 0;
+    }
+
+    try
+    {
+        SptTokenColumns to = *columns;
+        return tokenizer->take(to.capacity, [tokenizer, &to](size_t index, const Token& token) {
+            to.offsets[index] = tokenizer->offsetOf(token);
+            to.lengths[index] = (uint32_t)token.tokenString.size();
+            to.types[index] = (int32_t)token.typeFlags;
+            if (NULL != to.lines) to.lines[index] = (int32_t)token.startingLine;
+            if (NULL != to.characters) to.characters[index] = (int32_t)token.startingCharacter;
+        });
+    }
+    catch (exception& ex)
+    {
+        tokenizer->lastError = ex.what();
+        tokenizer->done = true;
+        return 0;
+    }
+}
+
+extern "C" EXPORT size_t sptNextOwnedBatch(SptTokenizer* tokenizer, size_t maxCount, int wantPositions, SptTokenBatch* batch)
+{
+    if (NULL == tokenizer || NULL == batch) return 0;
+    tokenizer->lastError.clear();
+
+    *batch = SptTokenBatch();
+
+    try
+    {
+        tokenizer->offsets.clear();
+        tokenizer->lengths.clear();
+        tokenizer->types.clear();
+        tokenizer->lines.clear();
+        tokenizer->characters.clear();
+
+        if (0 == maxCount) maxCount = SIZE_MAX;
+        tokenizer->take(maxCount, [tokenizer, wantPositions](size_t, const Token& token) {
+            tokenizer->offsets.push_back(tokenizer->offsetOf(token));
+            tokenizer->lengths.push_back((uint32_t)token.tokenString.size());
+            tokenizer->types.push_back((int32_t)token.typeFlags);
+            if (wantPositions)
+            {
+                tokenizer->lines.push_back((int32_t)token.startingLine);
+                tokenizer->characters.push_back((int32_t)token.startingCharacter);
+            }
+        });
+    }
+    catch (exception& ex)
+    {
+        tokenizer->lastError = ex.what();
+        tokenizer->done = true;
+        return 0;
+    }
+
+    batch->offsets = tokenizer->offsets.data();
+    batch->lengths = tokenizer->lengths.data();
+    batch->types = tokenizer->types.data();
+    batch->lines = wantPositions ? tokenizer->lines.data() : NULL;
+    batch->characters = wantPositions ? tokenizer->characters.data() : NULL;
+    batch->count = tokenizer->types.size();
+    return batch->count;
+}
+
+extern "C" EXPORT const char* sptLastError(const SptTokenizer* tokenizer)
+{
+    return (NULL == tokenizer) ? "No tokenizer" : tokenizer->lastError.c_str();
+}
+
+extern "C" EXPORT const char* sptTypeName(int32_t type)
+{
+    // The names are all string literals, so they end with a 0
+    string_view name = tokenTypeName(type & ~Token::packageName);
+    return name.empty() ? NULL : name.data();
+}
@@ -0,0 +1,103 @@
+#ifndef TOKENIZER_C_API_H_INCLUDED
+#define TOKENIZER_C_API_H_INCLUDED
+
+/*
+* A plain C interface to the Shadow Promises tokenizer, for Python (ctypes, cffi), Rust and the like.
+*
+*   SptTokenizer* tokenizer = sptCreate();
+*   if (SPT_OK == sptBegin(tokenizer, source, sourceLength, 0))
+*   {
+*       uint32_t offsets[1024], lengths[1024];
+*       int32_t types[1024];
+*       SptTokenColumns columns = { offsets, lengths, types, NULL, NULL, 1024 };
+*
+*       size_t count;
+*       while (0 < (count = sptNextBatch(tokenizer, &columns))) ... source + offsets[i], lengths[i] bytes ...
+*   }
+*   sptDestroy(tokenizer);
+*
+* The source stays the caller's - it is not copied, and must not change or go away until the next sptBegin.
+* Tokens come out as columns: the byte offset from the start of the source, the length and the Token typeFlags,
+* and the line and character when they are asked for.  Nothing is allocated per token, and no text is copied.
+* The source is scanned a few KB at a time as the batches are taken, so it is never all tokenized at once.
+*
+* The columns go into arrays the caller owns (sptNextBatch), or into arrays the SptTokenizer owns
+* (sptNextOwnedBatch), good until its next call.  The last token is endOfInput - offset is the source length,
+* length 0.
+*
+* No function throws.  The ones that fail return SPT_ERROR (or 0 tokens), and sptLastError says why.
+* An SptTokenizer is for one thread at a time, make one for each thread - they share the grammar.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "interop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Changes when a struct or function here changes in a way that breaks existing callers.
+#define SPT_ABI_VERSION 1
+
+// Status codes
+#define SPT_OK          0
+#define SPT_ERROR       (-1)
+#define SPT_TOO_LARGE   (-2)    // The offsets are 32 bit, so a source is at most 4GB
+
+// sptBegin flags
+#define SPT_LAZY_POSITIONS  1   // Skip the line and character bookkeeping, the lines and characters are all 0
+
+typedef struct SptTokenizer SptTokenizer;
+
+// Arrays owned by the caller.  capacity is the entries in each one.  lines and characters can be NULL.
+typedef struct SptTokenColumns
+{
+    uint32_t*   offsets;
+    uint32_t*   lengths;
+    int32_t*    types;
+    int32_t*    lines;
+    int32_t*    characters;
+    size_t      capacity;
+} SptTokenColumns;
+
+// Arrays owned by the SptTokenizer - good until its next call.
+typedef struct SptTokenBatch
+{
+    const uint32_t* offsets;
+    const uint32_t* lengths;
+    const int32_t*  types;
+    const int32_t*  lines;
+    const int32_t*  characters;
+    size_t          count;
+} SptTokenBatch;
+
+// SPT_ABI_VERSION of the library - check it matches the header the caller was built with.
+EXPORT uint32_t sptAbiVersion(void);
+
+// NULL if it could not be made.
+EXPORT SptTokenizer* sptCreate(void);
+EXPORT void sptDestroy(SptTokenizer* tokenizer);
+
+// Start on a new source.  Any tokens not yet taken from the last one are dropped.
+EXPORT int sptBegin(SptTokenizer* tokenizer, const char* source, size_t sourceLength, uint32_t flags);
+
+// Fill columns with the next tokens.  Returns how many, 0 once endOfInput has been taken.
+EXPORT size_t sptNextBatch(SptTokenizer* tokenizer, const SptTokenColumns* columns);
+
+// The next tokens, up to maxCount (0 for all of the rest) in the SptTokenizer's arrays.
+// Returns batch->count.  The lines and characters are NULL unless wantPositions.
+EXPORT size_t sptNextOwnedBatch(SptTokenizer* tokenizer, size_t maxCount, int wantPositions, SptTokenBatch* batch);
+
+// Why the last call failed, "" if it did not.  Good until the next call.
+EXPORT const char* sptLastError(const SptTokenizer* tokenizer);
+
+// The name of a token type ("identifier", "number" ...), NULL if it is not one.  The packageName flag is ignored.
+EXPORT const char* sptTypeName(int32_t type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TOKENIZER_C_API_H_INCLUDED
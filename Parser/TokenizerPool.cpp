@@ -0,0 +1,48 @@
+#include "pch.h"
+#include "TokenizerPool.h"
+
+TokenizerPool::TokenizerPool(function<Tokenizer*()> inNewTokenizer, size_t prepareCount) :
+    newTokenizer(std::move(inNewTokenizer)),
+    tokenizerCount(0)
+{
+    ready.reserve(prepareCount);
+    for (size_t i = 0; i < prepareCount; i++) ready.push_back(newTokenizer());
+    tokenizerCount = prepareCount;
+}
+
+TokenizerPool::~TokenizerPool()
+{
+    // Every Session should be gone by now
+    for (auto tokenizer : ready) delete tokenizer;
+}
+
+TokenizerPool::Session TokenizerPool::checkOut()
+{
+    {
+        lock_guard<mutex> lock(readyLock);
+        if (!ready.empty())
+        {
+            Tokenizer* tokenizer = ready.back();
+            ready.pop_back();
+            return Session(this, tokenizer);
+        }
+        tokenizerCount++;
+    }
+
+    // Make the new one outside the lock - building a grammar is not quick.
+    return Session(this, newTokenizer());
+}
+
+void TokenizerPool::checkIn(Tokenizer* tokenizer)
+{
+    tokenizer->reset();
+
+    lock_guard<mutex> lock(readyLock);
+    ready.push_back(tokenizer);
+}
+
+size_t TokenizerPool::size()
+{
+    lock_guard<mutex> lock(readyLock);
+    return tokenizerCount;
+}
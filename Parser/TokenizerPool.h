@@ -0,0 +1,70 @@
+#ifndef TOKENIZER_POOL_H_INCLUDED
+#define TOKENIZER_POOL_H_INCLUDED
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "Tokenizer.h"
+
+/*
+* Ready to use Tokenizers for a service that tokenizes many small requests on many threads.
+*
+*   TokenizerPool pool([] { return &initShadowPromisesTokenizer(); });
+*   ...
+*   {
+*       TokenizerPool::Session session = pool.checkOut();
+*       session->tokenize(request);
+*       ... use session->tokens ...
+*   }   // back in the pool
+*
+* A Tokenizer going back to the pool is reset(), so it keeps its token capacity, its ReadFileData objects and
+* their buffers, and the next request only scans.  There is a Tokenizer for each thread using the pool at once,
+* they are made by newTokenizer the first time they are needed.
+*/
+class EXPORT TokenizerPool
+{
+protected:
+    std::function<Tokenizer*()>     newTokenizer;
+    std::vector<Tokenizer*>         ready;
+    std::mutex                      readyLock;
+    size_t                          tokenizerCount;
+
+    void checkIn(Tokenizer* tokenizer);
+
+public:
+    // A checked out Tokenizer, it goes back to the pool when the Session is destroyed.
+    class EXPORT Session
+    {
+    protected:
+        TokenizerPool*  pool;
+        Tokenizer*      tokenizer;
+
+        friend class TokenizerPool;
+        Session(TokenizerPool* inPool, Tokenizer* inTokenizer) : pool(inPool), tokenizer(inTokenizer) {}
+
+    public:
+        Session(Session&& other) noexcept : pool(other.pool), tokenizer(other.tokenizer) { other.tokenizer = NULL; }
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+        ~Session() { if (NULL != tokenizer) pool->checkIn(tokenizer); }
+
+        Tokenizer& operator*() const { return *tokenizer; }
+        Tokenizer* operator->() const { return tokenizer; }
+    };
+
+    // newTokenizer makes a Tokenizer on the heap, the pool deletes them.  prepareCount are made now.
+    TokenizerPool(std::function<Tokenizer*()> inNewTokenizer, size_t prepareCount = 0);
+    ~TokenizerPool();
+
+    TokenizerPool(const TokenizerPool&) = delete;
+    TokenizerPool& operator=(const TokenizerPool&) = delete;
+
+    // A Tokenizer with no tokens or sources.  Thread safe.
+    Session checkOut();
+
+    // The Tokenizers made so far, checked out or not.
+    size_t size();
+};
+
+#endif // TOKENIZER_POOL_H_INCLUDED
@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "TokenizerStats.h"
+
+void TokenizerStats::clear()
+{
+    matchers.fill(Matcher{ 0, 0, 0 });
+    tokenTypes.fill(0);
+    scans = 0;
+}
+
+void TokenizerStats::add(const TokenizerStats& other)
+{
+    for (size_t i = 0; i < matchers.size(); i++)
+    {
+        matchers[i].calls += other.matchers[i].calls;
+        matchers[i].bytes += other.matchers[i].bytes;
+        matchers[i].nanoseconds += other.matchers[i].nanoseconds;
+    }
+    for (size_t i = 0; i < typeSlots; i++) tokenTypes[i] += other.tokenTypes[i];
+    scans += other.scans;
+}
+
+uint64_t TokenizerStats::tokenCount() const
+{
+    uint64_t count = 0;
+    for (auto tokens : tokenTypes) count += tokens;
+    return count;
+}
+
+uint64_t TokenizerStats::failureCount() const
+{
+    uint64_t count = 0;
+    for (size_t i = Token::failures; i < typeSlots; i++) count += tokenTypes[i];
+    return count;
+}
+
+void TokenizerStats::print(ostream& output) const
+{
+    if (!enabled)
+    {
+        output << "No statistics - the tokenizer was built without TOKENIZER_STATS" << endl;
+        return;
+    }
+
+    ios::fmtflags flags = output.flags();
+    streamsize precision = output.precision();
+
+    output << "Scans: " << scans << "  Tokens: " << tokenCount() << "  Failures: " << failureCount() << endl << endl;
+
+    output << left << setw(12) << "Matcher" << right << setw(12) << "Calls" << setw(14) << "Bytes" <<
+        setw(12) << "ms" << setw(12) << "MB/s" << setw(12) << "ns/call" << endl;
+
+    for (size_t key = 0; key < matchers.size(); key++)
+    {
+        const Matcher& matcher = matchers[key];
+        if (0 == matcher.calls) continue;
+
+        string name = (' ' == key) ? "whitespace" : string("'") + (char)key + "'";
+        double seconds = matcher.nanoseconds / 1e9;
+
+        output << left << setw(12) << name << right << setw(12) << matcher.calls << setw(14) << matcher.bytes <<
+            fixed << setprecision(2) << setw(12) << seconds * 1000 <<
+            setprecision(1) << setw(12) << ((0 < seconds) ? matcher.bytes / seconds / (1024 * 1024) : 0.0) <<
+            setw(12) << (double)matcher.nanoseconds / matcher.calls << endl;
+    }
+
+    output << endl << left << setw(26) << "Token type" << right << setw(12) << "Tokens" << endl;
+
+    for (size_t type = 0; type < typeSlots; type++)
+    {
+        if (0 == tokenTypes[type]) continue;
+
+        string name;
+        TokenFlagToString(name, (long)type);
+        output << left << setw(26) << name << right << setw(12) << tokenTypes[type] << endl;
+    }
+
+    output.flags(flags);
+    output.precision(precision);
+}
@@ -0,0 +1,61 @@
+#ifndef TOKENIZER_STATS_H_INCLUDED
+#define TOKENIZER_STATS_H_INCLUDED
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+
+/*
+* Where the scanning time goes - what each matcher was called for, and the tokens it made.
+*
+* The counting is only compiled in when TOKENIZER_STATS is defined.  Without it the scanning loop has no extra
+* code at all, and Tokenizer::getStatistics() is always empty.  With it every matcher call is timed, so expect
+* the tokenizer to be slower - use it to find what is expensive, not to measure the speed.
+*
+* Each scan counts into its own TokenizerStats and adds them to the Tokenizer's at the end, so the parallel
+* tokenizes only share a lock once per chunk.
+*/
+class EXPORT TokenizerStats
+{
+public:
+#ifdef TOKENIZER_STATS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    // Every typeFlags value is below this - the failures section is the last one.
+    static constexpr size_t typeSlots = 512;
+
+    struct Matcher
+    {
+        uint64_t    calls;
+        uint64_t    bytes;
+        uint64_t    nanoseconds;
+    };
+
+    // By tokenReadingMap key (lookupCharacter of the token's first character).  ' ' is the whitespace matcher.
+    std::array<Matcher, 256>        matchers;
+
+    // Tokens made, by typeFlags.  Tokenizer::failures on up are the failed tokens.
+    std::array<uint64_t, typeSlots> tokenTypes;
+
+    // The calls to the scanner
+    uint64_t                        scans;
+
+    TokenizerStats() { clear(); }
+
+    void clear();
+    void add(const TokenizerStats& other);
+
+    uint64_t tokenCount() const;
+
+    // All of the failures, or one kind (Token::badString, badNumber, badPunctuation, badUnknown or badEncoding).
+    uint64_t failureCount() const;
+    uint64_t failureCount(long failure) const { return tokenTypes[(size_t)failure % typeSlots]; }
+
+    // A table of the matchers, the token types and the failures.
+    void print(std::ostream& output) const;
+};
+
+#endif // TOKENIZER_STATS_H_INCLUDED
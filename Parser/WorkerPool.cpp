@@ -0,0 +1,120 @@
+#include "pch.h"
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(unsigned threadCount) :
+    stopping(false)
+{
+    if (0 == threadCount) threadCount = max(1u, thread::hardware_concurrency());
+
+    for (unsigned i = 0; i < threadCount; i++)
+    {
+        workers.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock(jobsLock);
+        stopping = true;
+    }
+    jobsAvailable.notify_all();
+
+    for (auto& worker : workers) worker.join();
+}
+
+void WorkerPool::workerLoop()
+{
+    while (true)
+    {
+        function<void()> job;
+        {
+            unique_lock<mutex> lock(jobsLock);
+            jobsAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+            if (jobs.empty()) return;   // stopping, and nothing left to do
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        job();
+    }
+}
+
+void WorkerPool::submit(function<void()> job)
+{
+    {
+        lock_guard<mutex> lock(jobsLock);
+        jobs.push_back(std::move(job));
+    }
+    jobsAvailable.notify_one();
+}
+
+// Shared between the caller and the helper jobs.  Helpers can start after parallelFor has returned,
+// so they only touch this (kept alive by the shared_ptr) until they have claimed an index.
+struct ParallelForState
+{
+    atomic<size_t>                      next;
+    size_t                              count;
+    const function<void(size_t)>*       work;
+
+    mutex                               doneLock;
+    condition_variable                  allDone;
+    size_t                              done;
+    exception_ptr                       firstException;
+
+    void runAvailable()
+    {
+        size_t index;
+        while ((index = next++) < count)
+        {
+            exception_ptr thrown;
+            try
+            {
+                (*work)(index);
+            }
+            catch (...)
+            {
+                thrown = current_exception();
+            }
+
+            lock_guard<mutex> lock(doneLock);
+            if (thrown && !firstException) firstException = thrown;
+            if (++done == count) allDone.notify_all();
+        }
+    }
+};
+
+void WorkerPool::parallelFor(size_t count, const function<void(size_t index)>& work, unsigned maxThreads)
+{
+    if (0 == count) return;
+
+    auto state = make_shared<ParallelForState>();
+    state->next = 0;
+    state->count = count;
+    state->work = &work;
+    state->done = 0;
+
+    // The caller is one of the threads
+    size_t helpers = min<size_t>(count - 1, workers.size());
+    if (0 < maxThreads) helpers = min<size_t>(helpers, maxThreads - 1);
+
+    for (size_t i = 0; i < helpers; i++)
+    {
+        submit([state]() { state->runAvailable(); });
+    }
+
+    state->runAvailable();
+
+    unique_lock<mutex> lock(state->doneLock);
+    state->allDone.wait(lock, [&state] { return state->done == state->count; });
+
+    if (state->firstException) rethrow_exception(state->firstException);
+}
+
+WorkerPool& WorkerPool::shared()
+{
+    static WorkerPool sharedPool;
+    return sharedPool;
+}
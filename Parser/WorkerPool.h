@@ -0,0 +1,48 @@
+#ifndef WORKERPOOL_H_INCLUDED
+#define WORKERPOOL_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/*
+* A fixed set of worker threads for the tokenizer.
+*
+* parallelFor runs work(0) .. work(count - 1) spread over the workers and the calling thread, and returns
+* when they have all finished.  The calling thread always takes part, so parallelFor can be called from
+* inside a worker without deadlocking.
+*/
+class EXPORT WorkerPool
+{
+protected:
+    std::vector<std::thread>            workers;
+    std::deque<std::function<void()>>   jobs;
+    std::mutex                          jobsLock;
+    std::condition_variable             jobsAvailable;
+    bool                                stopping;
+
+    void workerLoop();
+
+public:
+    // threadCount 0 uses one worker per hardware thread
+    WorkerPool(unsigned threadCount = 0);
+    ~WorkerPool();
+
+    unsigned size() const { return (unsigned)workers.size(); }
+
+    // Queue a job to run on a worker thread.
+    void submit(std::function<void()> job);
+
+    // Run work for each index and wait for all of them.  The first exception thrown by work is rethrown here.
+    // At most maxThreads threads (including the caller) are used, 0 uses them all.
+    void parallelFor(size_t count, const std::function<void(size_t index)>& work, unsigned maxThreads = 0);
+
+    // The pool the Tokenizer uses when it is not given one.
+    static WorkerPool& shared();
+};
+
+#endif // WORKERPOOL_H_INCLUDED
@@ -9,15 +9,21 @@
 
 // add headers that you want to pre-compile here
 #include <string>
+#ifdef _WIN32
 #include <xstring>
+#endif
 #include <array>
+#if __has_include(<format>)
 #include <format>
+#endif
 #include <iosfwd>
+#include <iomanip>
 #include <iostream>
 #include <map>
 #include <list>
 #include <set>
 #include <span>
+#include <sstream>
 #include <vector>
 #include <boost/filesystem.hpp>
 #include <boost/iostreams/device/mapped_file.hpp>
@@ -25,11 +31,27 @@
 #include "interop.h"
 #include "ReadFileData.h"
 #include "framework.h"
+#include "WorkerPool.h"
+#include "FileIngestor.h"
+#include "AtomTable.h"
+#include "TokenArena.h"
+#include "TokenizerStats.h"
 #include "TokenScanning.h"
 #include "Tokenizer.h"
+#include "GrammarScanning.h"
+#include "KeywordTable.h"
+#include "CompactTokens.h"
+#include "TokenDump.h"
+#include "TokenCache.h"
+#include "TokenCursor.h"
+#include "StringLiterals.h"
+#include "NumericValues.h"
+#include "TokenTrivia.h"
+#include "TokenizerPool.h"
 #include "SymbolTable.h"
 #include "Parser.h"
 #include "ShadowPromisesTokenizer.h"
+#include "TokenizerCApi.h"
 
 // The C++ 20 STL COOKBOOK  - in general it seems to be a good book
 // Claimied that it is a better practace to just using for the specific
@@ -2,7 +2,12 @@
 
 #include <iostream>
 #include <string>
+#include <cstring>      // strcmp
 #include <fstream>      // ifstream
+#ifdef _WIN32
+#include <fcntl.h>      // _setmode for --format binary
+#include <io.h>
+#endif
 
 #include "..\Parser\ShadowPromisesTokenizer.h"
 
@@ -13,50 +18,110 @@ int main(int argc, char* argv[], char* envp[])
     bool wasInputFileFound = false;
 
 
+    vector<boost::filesystem::path> filePaths;
+    unsigned threadCount = 0;
+    bool showStats = false;
+    TokenDumpFormat format = TokenDumpFormat::human;
+    unique_ptr<TokenCache> tokenCache;
+
     if (argc > 1)
     {
-        ifstream fileInput;
-
-        char* option = NULL;
         for (int i = 1; i < argc; i++)
         {
-            if (fileInput.is_open()) fileInput.close();
-
             if (L'-' == argv[i][0])
             {
-                option = argv[i] + 1;
+                char* option = argv[i] + 1;
+
+                // -j N or -jN: the number of threads to tokenize with
+                if ('j' == option[0])
+                {
+                    const char* count = option + 1;
+                    if (0 == *count && i + 1 < argc) count = argv[++i];
+                    threadCount = (unsigned)atoi(count);
+                }
+                // --stats: what the scanning did, after the tokens (on stderr for json and binary).  Needs a build with TOKENIZER_STATS.
+                else if (0 == strcmp(option, "-stats"))
+                {
+                    showStats = true;
+                }
+                // --cache directory: keep the tokens of the files, and skip scanning them when they have not changed
+                else if (0 == strcmp(option, "-cache") && i + 1 < argc)
+                {
+                    tokenCache = make_unique<TokenCache>(argv[++i]);
+                    shadowPromisesTokenizer.tokenCache = tokenCache.get();
+                }
+                // --format human|json|binary|summary: how the tokens are written
+                else if (0 == strcmp(option, "-format") && i + 1 < argc)
+                {
+                    if (!parseTokenDumpFormat(argv[++i], format))
+                    {
+                        std::cerr << "Unknown format \"" << argv[i] << "\" - use human, json, binary or summary" << endl;
+                        return 1;
+                    }
+                }
             }
             else
             {
-                try
-                {
-                    wasInputFileFound = true;
-                    boost::filesystem::path testPath(argv[i]);
-                    std::cout << "Tokenizing \"" << argv[i] << "\"" << endl << endl;
+                filePaths.emplace_back(argv[i]);
+            }
+        }
+    }
 
-                    shadowPromisesTokenizer.tokenize(testPath);
+#ifdef _WIN32
+    if (TokenDumpFormat::binary == format) _setmode(_fileno(stdout), _O_BINARY);
+#endif
 
-                    dumpTokens(std::cout, shadowPromisesTokenizer.tokens);
+    // Only the human format gets the headings - the others are read by other tools.
+    bool isHuman = (TokenDumpFormat::human == format);
+    TokenDumper dumper(std::cout, format);
 
-                }
-                catch (exception& ex)
+    if (!filePaths.empty())
+    {
+        wasInputFileFound = true;
+
+        vector<TokenizedFile> results = shadowPromisesTokenizer.tokenizeAll(filePaths, threadCount);
+
+        for (auto& result : results)
+        {
+            if (result.error.empty())
+            {
+                if (isHuman)
                 {
-                    std::cout << "Could not open \"" << argv[i] << "\" as a file.  " <<
-                        ex.what() << endl << endl;
+                    dumper.flush();
+                    std::cout << "Tokenizing \"" << result.filePath.string() << "\"" << endl << endl;
                 }
 
-                shadowPromisesTokenizer.cleanup();
+                dumper.setTokenIndex(0);
+                dumper.dump(result.tokens);
+            }
+            else
+            {
+                dumper.flush();
+                (isHuman ? std::cout : std::cerr) << "Could not open \"" << result.filePath.string() << "\" as a file.  " <<
+                    result.error << endl << endl;
             }
         }
+
+        shadowPromisesTokenizer.cleanup();
     }
 
     if (!wasInputFileFound)
     {
-        std::cout << "Enter the text to tokenize:" << endl;
+        if (isHuman) std::cout << "Enter the text to tokenize:" << endl;
 
-        shadowPromisesTokenizer.tokenize(std::cin);
-        dumpTokens(std::cout, shadowPromisesTokenizer.tokens);
+        // Stream it - the input can be a long pipe from another tool.  The dumper keeps counting the token index.
+        shadowPromisesTokenizer.tokenizeStream(std::cin, [&dumper](token_vector& chunkTokens) {
+                dumper.dump(chunkTokens);
+            });
+    }
 
-        shadowPromisesTokenizer.cleanup();
+    dumper.finish();
+
+    if (showStats)
+    {
+        // Not in the middle of json or binary output
+        ostream& statsOutput = isHuman ? std::cout : std::cerr;
+        statsOutput << endl;
+        shadowPromisesTokenizer.getStatistics().print(statsOutput);
     }
 }
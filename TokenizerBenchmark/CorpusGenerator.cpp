@@ -0,0 +1,366 @@
+#include "CorpusGenerator.h"
+
+#include <array>
+#include <cctype>
+
+using namespace std;
+
+static const char* const mixNames[] = { "mixed", "identifiers", "strings", "comments", "numbers", "nested" };
+
+const char* corpusMixName(CorpusMix mix)
+{
+    return mixNames[(size_t)mix];
+}
+
+bool parseCorpusMix(string_view name, CorpusMix& mix)
+{
+    for (size_t i = 0; i < (size_t)CorpusMix::count; i++)
+    {
+        if (name == mixNames[i])
+        {
+            mix = (CorpusMix)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace
+{
+    enum StatementKind { assignStatement, callStatement, ifElseStatement, loopStatement, functionStatement, commentStatement, statementKinds };
+    enum ValueKind { numberValue, stringValue, identifierValue, valueKinds };
+
+    // How often each kind comes up, out of the sum of the row.
+    struct MixWeights
+    {
+        array<unsigned, statementKinds> statements;
+        array<unsigned, valueKinds>     values;
+        int                             maxDepth;
+    };
+
+    const MixWeights mixWeights[] = {
+        { { 30, 20, 10,  5,  5, 10 }, {  40,  20, 40 },  4 },     // mixed
+        { { 40, 40,  5,  5, 10,  0 }, {   5,   0, 95 },  4 },     // identifiers
+        { { 70, 30,  0,  0,  0,  0 }, {   0, 100,  0 },  1 },     // strings
+        { { 10,  0,  0,  0,  0, 90 }, {  30,  10, 60 },  1 },     // comments
+        { { 60, 40,  0,  0,  0,  0 }, { 100,   0,  0 },  1 },     // numbers
+        { {  5,  5, 45, 25, 20,  0 }, {  40,  10, 50 }, 64 },     // nested
+    };
+
+    const char* const words[] = {
+        "alpha", "beta", "count", "delta", "index", "value", "result", "total", "item", "list",
+        "file", "name", "retry", "open", "read", "buffer", "size", "next", "first", "last",
+    };
+
+    const char* const packageNames[] = { "s:Random", "s:print", "io:open", "io:read", "math:sqrt", "list:map" };
+
+    const char* const keywords[] = { ":and", ":or", ":nand", ":add", ":equals", ":listReduce", ":startAsync", ":self" };
+
+    class CorpusWriter
+    {
+    protected:
+        const MixWeights&   weights;
+        uint64_t            state;
+        string&             out;
+        size_t              targetBytes;
+
+        // splitmix64
+        uint64_t next()
+        {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        unsigned below(unsigned limit) { return (unsigned)(next() % limit); }
+
+        template <size_t N>
+        unsigned pick(const array<unsigned, N>& odds)
+        {
+            unsigned total = 0;
+            for (auto odd : odds) total += odd;
+
+            unsigned roll = below(total);
+            for (unsigned i = 0; i < N; i++)
+            {
+                if (roll < odds[i]) return i;
+                roll -= odds[i];
+            }
+            return 0;
+        }
+
+        template <size_t N>
+        const char* pick(const char* const (&choices)[N]) { return choices[below(N)]; }
+
+        bool full() const { return out.size() >= targetBytes; }
+
+        void indent(int depth) { out.append(depth, '\t'); }
+
+        void identifier()
+        {
+            switch (below(6))
+            {
+            case 0:
+                out += pick(packageNames);
+                break;
+            case 1:
+                out += pick(keywords);
+                break;
+            case 2:
+            {
+                // camelCase
+                out += pick(words);
+                size_t second = out.size();
+                out += pick(words);
+                out[second] = (char)toupper(out[second]);
+                break;
+            }
+            case 3:
+                // _ is punctuation, it can not start an identifier
+                out += pick(words);
+                out += '_';
+                out += to_string(below(100));
+                break;
+            default:
+                out += pick(words);
+                out += to_string(below(10));
+                break;
+            }
+
+            if (0 == below(10))
+            {
+                out += '.';
+                out += pick(words);
+            }
+        }
+
+        void number()
+        {
+            switch (below(6))
+            {
+            case 0:
+                out += to_string(below(100000));
+                break;
+            case 1:
+                out += to_string(below(1000));
+                out += '.';
+                out += to_string(below(1000));
+                break;
+            case 2:
+                out += to_string(1 + below(9));
+                out += '.';
+                out += to_string(below(10));
+                out += 'e';
+                out += to_string(below(20));
+                break;
+            case 3:
+                out += "-.";
+                out += to_string(1 + below(9));
+                out += "e-";
+                out += to_string(1 + below(9));
+                break;
+            case 4:
+                out += '-';
+                out += to_string(below(10000));
+                break;
+            default:
+            {
+                static const char hexDigits[] = "0123456789ABCDEF";
+                out += "0x";
+                for (unsigned i = 1 + below(8); 0 < i; i--) out += hexDigits[below(16)];
+                break;
+            }
+            }
+        }
+
+        void quotedString()
+        {
+            char quote = below(2) ? '\'' : '"';
+            out += quote;
+
+            for (unsigned i = 2 + below(10); 0 < i; i--)
+            {
+                out += pick(words);
+                switch (below(12))
+                {
+                case 0:
+                    out += "\\u{25B2}";
+                    break;
+                case 1:
+                    out += '\\';
+                    out += quote;
+                    break;
+                case 2:
+                    out += "\\x{0a}";
+                    break;
+                case 3:
+                    out += '\n';        // a multi-line string
+                    break;
+                default:
+                    out += ' ';
+                    break;
+                }
+            }
+
+            out += quote;
+        }
+
+        void value()
+        {
+            switch (pick(weights.values))
+            {
+            case numberValue:
+                number();
+                break;
+            case stringValue:
+                quotedString();
+                break;
+            default:
+                identifier();
+                break;
+            }
+        }
+
+        void commentWords(unsigned count)
+        {
+            for (; 0 < count; count--)
+            {
+                out += ' ';
+                out += pick(words);
+            }
+        }
+
+        void block(int depth)
+        {
+            out += "{\n";
+            for (unsigned i = 1 + below(3); 0 < i; i--) statement(depth + 1);
+            indent(depth);
+            out += '}';
+        }
+
+        void statement(int depth)
+        {
+            unsigned kind = pick(weights.statements);
+
+            // Stop going deeper at the depth limit, or once there is enough source.
+            if ((depth >= weights.maxDepth || full()) && (ifElseStatement <= kind && kind <= functionStatement)) kind = assignStatement;
+
+            indent(depth);
+            switch (kind)
+            {
+            case assignStatement:
+                value();
+                out += " @ ";
+                identifier();
+                break;
+
+            case callStatement:
+                identifier();
+                out += "(\n";
+                for (unsigned i = 1 + below(4); 0 < i; i--)
+                {
+                    indent(depth + 1);
+                    value();
+                    out += '\n';
+                }
+                indent(depth);
+                out += ") @ ";
+                identifier();
+                break;
+
+            case ifElseStatement:
+                out += ":if ";
+                block(depth);
+                if (below(2))
+                {
+                    out += " :else ";
+                    block(depth);
+                }
+                break;
+
+            case loopStatement:
+                out += ":loop {\n";
+                indent(depth + 1);
+                out += ":test(\n";
+                indent(depth + 2);
+                identifier();
+                out += '\n';
+                indent(depth + 1);
+                out += ")\n";
+                statement(depth + 1);
+                indent(depth + 1);
+                out += ":exit\n";
+                indent(depth);
+                out += '}';
+                break;
+
+            case functionStatement:
+                out += "[\n";
+                indent(depth + 1);
+                out += "double in\n";
+                indent(depth);
+                out += "]\n";
+                indent(depth);
+                out += "{\n";
+                statement(depth + 1);
+                indent(depth + 1);
+                out += ":return in\n";
+                indent(depth);
+                out += "} @ ";
+                out += pick(words);
+                break;
+
+            default:
+                if (below(3))
+                {
+                    out += "//";
+                    commentWords(3 + below(12));
+                }
+                else
+                {
+                    // * comments run over lines
+                    out += '*';
+                    for (unsigned lines = 1 + below(4); 0 < lines; lines--)
+                    {
+                        commentWords(4 + below(8));
+                        out += '\n';
+                    }
+                    out += '*';
+                }
+                break;
+            }
+
+            // A trailing comment now and then
+            if (commentStatement != kind && 0 != weights.statements[commentStatement] && 0 == below(8))
+            {
+                out += "\t//";
+                commentWords(2 + below(4));
+            }
+            out += '\n';
+        }
+
+    public:
+        CorpusWriter(const CorpusOptions& options, string& inOut) :
+            weights(mixWeights[(size_t)options.mix]),
+            state(options.seed),
+            out(inOut),
+            targetBytes(options.bytes)
+        {}
+
+        void write()
+        {
+            while (!full()) statement(0);
+        }
+    };
+}
+
+string generateCorpus(const CorpusOptions& options)
+{
+    string corpus;
+    corpus.reserve(options.bytes + 4096);
+
+    CorpusWriter(options, corpus).write();
+
+    return corpus;
+}
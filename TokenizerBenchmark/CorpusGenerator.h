@@ -0,0 +1,42 @@
+#ifndef CORPUS_GENERATOR_H_INCLUDED
+#define CORPUS_GENERATOR_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+* Synthetic Shadow Promises source for the benchmark.
+*
+* The same options always give the same bytes - the random numbers come from a fixed splitmix64 sequence,
+* not the library's distributions, so the corpus is the same on every platform and compiler.
+* Each mix leans on one kind of token, so its numbers show the speed of one matcher.
+*/
+enum class CorpusMix
+{
+    mixed,          // Like TestCode.sp - a bit of everything
+    identifiers,    // Calls, assignments and :keywords
+    strings,        // Quoted strings with escapes, some multi-line
+    comments,       // // and * * comments
+    numbers,        // Decimal, exponent, negative and hex numbers
+    nested,         // Blocks and parameter lists nested deep
+
+    count
+};
+
+struct CorpusOptions
+{
+    CorpusMix   mix = CorpusMix::mixed;
+    size_t      bytes = 16 * 1024 * 1024;
+    uint64_t    seed = 1;
+};
+
+const char* corpusMixName(CorpusMix mix);
+
+// False if name is not one of the corpusMixName names.
+bool parseCorpusMix(std::string_view name, CorpusMix& mix);
+
+// About options.bytes of source - it stops at the first statement end past that.
+std::string generateCorpus(const CorpusOptions& options);
+
+#endif // CORPUS_GENERATOR_H_INCLUDED
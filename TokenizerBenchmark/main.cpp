@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../Parser/ShadowPromisesTokenizer.h"
+#include "CorpusGenerator.h"
+
+using namespace std;
+
+/*
+* Tokenizer throughput on generated Shadow Promises source.
+*
+*   TokenizerBenchmark [--size MB] [--mix name|all] [--seed N] [--repeat N] [--write file]
+*
+* For each corpus mix it prints the end to end numbers for Tokenizer::tokenize, then the numbers for each matcher
+* in the grammar run over just the tokens it matches.  Every time is the best of --repeat runs.
+*/
+
+typedef chrono::steady_clock benchClock;
+
+struct BenchOptions
+{
+    CorpusOptions   corpus;
+    bool            allMixes = true;
+    unsigned        repeat = 5;
+    const char*     writeTo = NULL;
+};
+
+static void usage()
+{
+    cerr << "TokenizerBenchmark [--size MB] [--mix name|all] [--seed N] [--repeat N] [--write file]" << endl <<
+        "  mixes: all";
+    for (size_t i = 0; i < (size_t)CorpusMix::count; i++) cerr << ", " << corpusMixName((CorpusMix)i);
+    cerr << endl;
+}
+
+static bool parseOptions(int argc, char* argv[], BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* option = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (NULL == value) return false;
+        i++;
+
+        if (0 == strcmp(option, "--size"))
+        {
+            options.corpus.bytes = (size_t)(atof(value) * 1024 * 1024);
+        }
+        else if (0 == strcmp(option, "--mix"))
+        {
+            options.allMixes = (0 == strcmp(value, "all"));
+            if (!options.allMixes && !parseCorpusMix(value, options.corpus.mix)) return false;
+        }
+        else if (0 == strcmp(option, "--seed"))
+        {
+            options.corpus.seed = strtoull(value, NULL, 10);
+        }
+        else if (0 == strcmp(option, "--repeat"))
+        {
+            options.repeat = max(1, atoi(value));
+        }
+        else if (0 == strcmp(option, "--write"))
+        {
+            options.writeTo = value;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return 0 < options.corpus.bytes;
+}
+
+// The best time of repeat calls to run, in seconds.
+template <typename Run>
+static double bestOf(unsigned repeat, Run run)
+{
+    double best = 0;
+    for (unsigned i = 0; i < repeat; i++)
+    {
+        auto start = benchClock::now();
+        run();
+        double seconds = chrono::duration<double>(benchClock::now() - start).count();
+        if (0 == i || seconds < best) best = seconds;
+    }
+    return best;
+}
+
+static void printRate(const char* name, size_t bytes, size_t tokens, double seconds)
+{
+    cout << "  " << left << setw(20) << name << right <<
+        setw(12) << bytes << " bytes" <<
+        setw(11) << tokens << " tokens" <<
+        setw(10) << fixed << setprecision(2) << seconds * 1000 << " ms" <<
+        setw(10) << setprecision(1) << bytes / seconds / (1024 * 1024) << " MB/s" <<
+        setw(10) << setprecision(2) << tokens / seconds / 1e6 << " Mtokens/s" << endl;
+}
+
+// What the grammar's matcher for a tokenReadingMap key matches.
+static const char* matcherName(char key)
+{
+    switch (key)
+    {
+    case ' ':   return "whitespace";
+    case '"':   return "string \"";
+    case '\'':  return "string '";
+    case '0':   return "number";
+    case '-':   return "number -";
+    case '/':   return "comment //";
+    case '*':   return "comment * *";
+    case 'a':   return "identifier";
+    }
+    return "punctuation";
+}
+
+// The time for each matcher over the tokens it matched in the tokenize run.
+static void benchMatchers(Tokenizer& tokenizer, string_view corpus, unsigned repeat)
+{
+    const char* end = corpus.data() + corpus.size();
+
+    // The token starts for each key, and where the whitespace after each token starts.
+    map<char, vector<const char*>> startsByKey;
+    vector<const char*>& whitespaceStarts = startsByKey[' '];
+    for (auto& token : tokenizer.tokens)
+    {
+        if (token.tokenString.empty()) continue;
+
+        startsByKey[lookupCharacter(token.tokenString[0])].push_back(token.tokenString.data());
+
+        const char* after = token.tokenString.data() + token.tokenString.size();
+        if (after < end && isSpaceChar(*after)) whitespaceStarts.push_back(after);
+    }
+
+    // Keep the compiler from dropping the matcher calls
+    size_t sink = 0;
+    size_t punctuationTokens = 0;
+
+    for (auto& [key, starts] : startsByKey)
+    {
+        auto found = tokenizer.tokenReadingMap.find(key);
+        if (tokenizer.tokenReadingMap.end() == found) continue;
+
+        TokenMatching* matching = found->second;
+        if (matching->isSingleCharacterMatch())
+        {
+            punctuationTokens += starts.size();
+            continue;
+        }
+
+        size_t bytes = 0;
+        for (auto start : starts) bytes += matching->tokenMatcher(start, end, matching->matchOrSpecial).length;
+
+        double seconds = bestOf(repeat, [&] {
+                for (auto start : starts) sink += matching->tokenMatcher(start, end, matching->matchOrSpecial).length;
+            });
+
+        if (!starts.empty()) printRate(matcherName(key), bytes, starts.size(), seconds);
+    }
+
+    if (0 < punctuationTokens) cout << "  " << left << setw(20) << "punctuation" << right << setw(29) << punctuationTokens << " tokens (single character, no matcher)" << endl;
+    if (0 == sink) cout << "  (no bytes matched)" << endl;
+}
+
+static void benchMix(const BenchOptions& options, CorpusMix mix)
+{
+    CorpusOptions corpusOptions = options.corpus;
+    corpusOptions.mix = mix;
+    string corpus = generateCorpus(corpusOptions);
+
+    if (NULL != options.writeTo)
+    {
+        string fileName = options.writeTo;
+        if (options.allMixes) fileName += string(".") + corpusMixName(mix) + ".sp";
+
+        ofstream out(fileName, ios::binary);
+        out << corpus;
+    }
+
+    Tokenizer& tokenizer = initShadowPromisesTokenizer();
+
+    cout << corpusMixName(mix) << " (seed " << corpusOptions.seed << ")" << endl;
+
+    // The first run sizes the token storage, the timed runs reuse it like a pooled Tokenizer would.
+    tokenizer.tokenize(string_view(corpus));
+    size_t tokenCount = tokenizer.tokens.size();
+
+    // The generator should only write good source, failures would time the error paths instead.
+    size_t failedCount = count_if(tokenizer.tokens.begin(), tokenizer.tokens.end(), [](const Token& token) { return Token::failures <= token.typeFlags; });
+    if (0 < failedCount) cout << "  " << failedCount << " tokens failed" << endl;
+
+    double seconds = bestOf(options.repeat, [&] {
+            tokenizer.reset();
+            tokenizer.tokenize(string_view(corpus));
+        });
+    printRate("tokenize", corpus.size(), tokenCount, seconds);
+
+    tokenizer.lazyPositions = true;
+    seconds = bestOf(options.repeat, [&] {
+            tokenizer.reset();
+            tokenizer.tokenize(string_view(corpus));
+        });
+    printRate("tokenize (lazy)", corpus.size(), tokenCount, seconds);
+    tokenizer.lazyPositions = false;
+
+    tokenizer.reset();
+    tokenizer.tokenize(string_view(corpus));
+    benchMatchers(tokenizer, corpus, options.repeat);
+
+    cout << endl;
+
+    delete &tokenizer;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    if (options.allMixes)
+    {
+        for (size_t i = 0; i < (size_t)CorpusMix::count; i++) benchMix(options, (CorpusMix)i);
+    }
+    else
+    {
+        benchMix(options, options.corpus.mix);
+    }
+
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include "CppUnitTest.h"
 #include "..\Parser\ShadowPromisesTokenizer.h"
 #include "..\Parser\Parser.h"
+#include "..\Parser\SimdScanning.h"
 
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -528,6 +529,1391 @@ namespace TokenizerTests
 			Assert::AreEqual((long)1, tokenIter->startingCharacter);
 		}
 
+		TEST_METHOD(ScanningKernelsMatchScalar)
+		{
+			Logger::WriteMessage("In ScanningKernelsMatchScalar");
+
+			// Long runs so the vector kernels do full 16 and 32 byte steps, with the stops at every offset.
+			string source;
+			for (int i = 0; i < 40; i++)
+			{
+				source += string(i, ' ') + "\n" + string(i, '\t') + "identifier_" + string(i, 'x') + "\u00e9 ";
+				source += "'string " + string(i, 's') + "\\' \n still string' ";
+				source += "* comment\n" + string(i, 'c') + " * // line comment " + string(i, '/') + "\n";
+			}
+
+			auto startingLevel = scanKernels->level;
+
+			selectScanningKernels(ScanningKernels::scalar);
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(string_view(source));
+			token_vector scalarTokens = shadowPromisesTokenizer.tokens;
+
+			selectScanningKernels(ScanningKernels::best);
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(string_view(source));
+
+			Assert::AreEqual(scalarTokens.size(), shadowPromisesTokenizer.tokens.size());
+			for (size_t i = 0; i < scalarTokens.size(); i++)
+			{
+				Token& scalarToken = scalarTokens[i];
+				Token& token = shadowPromisesTokenizer.tokens[i];
+				Assert::AreEqual(scalarToken.tokenString, token.tokenString);
+				Assert::AreEqual(scalarToken.typeFlags, token.typeFlags);
+				Assert::AreEqual(scalarToken.startingLine, token.startingLine);
+				Assert::AreEqual(scalarToken.startingCharacter, token.startingCharacter);
+			}
+
+			// The line comment ends before the '\n', so it is only counted once.
+			auto tokenIter = shadowPromisesTokenizer.tokens.begin();
+			while (tokenIter->typeFlags != Token::TokenType::comment) tokenIter++;
+			Assert::AreEqual("// line comment "sv, tokenIter->tokenString);
+			long commentLine = tokenIter->startingLine;
+
+			tokenIter++;
+			Assert::AreEqual("identifier_x\u00e9"sv, tokenIter->tokenString);
+			Assert::AreEqual(commentLine + 2, tokenIter->startingLine);
+			Assert::AreEqual((long)2, tokenIter->startingCharacter);
+
+			selectScanningKernels(startingLevel);
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(StaticGrammarMatchesRuntime)
+		{
+			Logger::WriteMessage("In StaticGrammarMatchesRuntime");
+
+			// The same rules through the tokenReadingMap and idToTokenType function pointers.
+			Tokenizer runtimeTokenizer(ShadowPromisesGrammar::newTokenReadingMap(), shadowPromisesIdToTokenType);
+
+			boost::filesystem::path testPath("TestCode.sp");
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(testPath);
+			runtimeTokenizer.tokenize(testPath);
+
+			Assert::AreEqual(runtimeTokenizer.tokens.size(), shadowPromisesTokenizer.tokens.size());
+			for (size_t i = 0; i < runtimeTokenizer.tokens.size(); i++)
+			{
+				Token& runtimeToken = runtimeTokenizer.tokens[i];
+				Token& token = shadowPromisesTokenizer.tokens[i];
+				Assert::AreEqual(runtimeToken.tokenString, token.tokenString);
+				Assert::AreEqual(runtimeToken.typeFlags, token.typeFlags);
+				Assert::AreEqual(runtimeToken.startingLine, token.startingLine);
+				Assert::AreEqual(runtimeToken.startingCharacter, token.startingCharacter);
+			}
+
+			runtimeTokenizer.cleanup();
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(ParallelTokenizeMatchesSequential)
+		{
+			Logger::WriteMessage("In ParallelTokenizeMatchesSequential");
+
+			// Multi-line strings and comments so chunks start inside tokens.
+			string source;
+			for (int i = 0; i < 200; i++)
+			{
+				source += "value" + to_string(i) + " { (1 -2.5 0x1F) }\n";
+				source += "\"a string\n that spans { lines \\\" [ still\n the string\" after\n";
+				source += "* a comment\n\"with a quote\n * / not a comment\n";
+				source += "\t_bad #also bad\n";
+			}
+
+			Tokenizer sequentialTokenizer(ShadowPromisesGrammar::newTokenReadingMap(), shadowPromisesIdToTokenType);
+			sequentialTokenizer.tokenize(string_view(source));
+
+			WorkerPool pool(3);
+			for (size_t chunkSize : { 7, 64, 1000 })
+			{
+				shadowPromisesTokenizer.cleanup();
+				shadowPromisesTokenizer.parallelChunkSize = chunkSize;
+				shadowPromisesTokenizer.tokenizeParallel(string_view(source), 0, &pool);
+
+				Assert::AreEqual(sequentialTokenizer.tokens.size(), shadowPromisesTokenizer.tokens.size());
+				for (size_t i = 0; i < sequentialTokenizer.tokens.size(); i++)
+				{
+					Token& sequentialToken = sequentialTokenizer.tokens[i];
+					Token& token = shadowPromisesTokenizer.tokens[i];
+					Assert::AreEqual(sequentialToken.tokenString, token.tokenString);
+					Assert::AreEqual(sequentialToken.typeFlags, token.typeFlags);
+					Assert::AreEqual(sequentialToken.startingLine, token.startingLine);
+					Assert::AreEqual(sequentialToken.startingCharacter, token.startingCharacter);
+				}
+			}
+
+			shadowPromisesTokenizer.parallelChunkSize = 1024 * 1024;
+			sequentialTokenizer.cleanup();
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(TokenizeStreamMatchesTokenize)
+		{
+			Logger::WriteMessage("In TokenizeStreamMatchesTokenize");
+
+			// Over 1M so reading an istream needs more than the first buffer.
+			string source;
+			while (source.size() < 1100 * 1024)
+			{
+				source += "value { (1 -2.5 0x1F) }\n";
+				source += "\"a string\n that spans { lines \\\" [ still\n the string\" after\n";
+				source += "* a comment\n\"with a quote\n * / line comment\n";
+			}
+
+			Tokenizer sequentialTokenizer(ShadowPromisesGrammar::newTokenReadingMap(), shadowPromisesIdToTokenType);
+			sequentialTokenizer.tokenize(string_view(source));
+
+			shadowPromisesTokenizer.cleanup();
+			istringstream wholeInput(source);
+			shadowPromisesTokenizer.tokenize(wholeInput);
+			Assert::AreEqual(sequentialTokenizer.tokens.size(), shadowPromisesTokenizer.tokens.size());
+			shadowPromisesTokenizer.cleanup();
+
+			// The tokenStrings are only valid in the callback, so check them there.
+			istringstream streamInput(source);
+			size_t tokenIndex = 0;
+			shadowPromisesTokenizer.tokenizeStream(streamInput, [&sequentialTokenizer, &tokenIndex](token_vector& chunkTokens) {
+					for (Token& token : chunkTokens)
+					{
+						Assert::IsTrue(tokenIndex < sequentialTokenizer.tokens.size());
+
+						Token& sequentialToken = sequentialTokenizer.tokens[tokenIndex++];
+						Assert::AreEqual(sequentialToken.tokenString, token.tokenString);
+						Assert::AreEqual(sequentialToken.typeFlags, token.typeFlags);
+						Assert::AreEqual(sequentialToken.startingLine, token.startingLine);
+						Assert::AreEqual(sequentialToken.startingCharacter, token.startingCharacter);
+					}
+				}, 1000);
+			Assert::AreEqual(sequentialTokenizer.tokens.size(), tokenIndex);
+
+			sequentialTokenizer.cleanup();
+		}
+
+		TEST_METHOD(CompactTokenStoreMatchesTokens)
+		{
+			Logger::WriteMessage("In CompactTokenStoreMatchesTokens");
+
+			string_view source = "\xEF\xBB\xBF" "first {\n\t\"multi\nline\" 12 -3.5\n\n  * comment\n*  last_one\n"sv;
+
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(source);
+
+			CompactTokenStore store(source, shadowPromisesTokenizer.tokens);
+			store.setHasScope(1, true);
+
+			Assert::AreEqual(shadowPromisesTokenizer.tokens.size(), store.size());
+			Assert::IsTrue(store.hasScope(1));
+			Assert::IsFalse(store.hasScope(0));
+
+			token_vector tokens = store.toTokenVector();
+			size_t i = 0;
+			for (Token token : store)
+			{
+				Token& original = shadowPromisesTokenizer.tokens[i];
+				Assert::AreEqual(original.tokenString, token.tokenString);
+				Assert::IsTrue(original.tokenString.data() == token.tokenString.data());
+				Assert::AreEqual(original.typeFlags, token.typeFlags);
+				Assert::AreEqual(original.startingLine, token.startingLine);
+				Assert::AreEqual(original.startingCharacter, token.startingCharacter);
+
+				Assert::AreEqual(original.tokenString, tokens[i].tokenString);
+				Assert::AreEqual(original.startingLine, tokens[i].startingLine);
+				Assert::AreEqual(original.startingCharacter, tokens[i].startingCharacter);
+				i++;
+			}
+			Assert::AreEqual((long)Token::endOfInput, store.typeFlags(store.size() - 1));
+
+			Assert::IsTrue(source.data() + source.size() == store.tokenString(store.size() - 1).data());
+
+			Token endOfInput = store[store.size() - 1];
+			Assert::IsTrue(shadowPromisesTokenizer.resolvePosition(endOfInput));
+			Assert::AreEqual(shadowPromisesTokenizer.tokens.back().startingLine, endOfInput.startingLine);
+
+			// Characters counted in code points
+			string_view wide = "\xEF\xBB\xBF\xC3\xA9\xC3\xA9\xC3\xA9 x\n  'a\xE2\x96\xB2\nb\xE2\x96\xB2' y\xFF z\n"sv;
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.codePointColumns = true;
+			shadowPromisesTokenizer.tokenize(wide);
+			shadowPromisesTokenizer.codePointColumns = false;
+
+			CompactTokenStore wideStore(wide, shadowPromisesTokenizer.tokens, true);
+			Assert::AreEqual(5L, shadowPromisesTokenizer.tokens[1].startingCharacter);
+			for (size_t i = 0; i < wideStore.size(); i++)
+			{
+				Assert::AreEqual(shadowPromisesTokenizer.tokens[i].startingLine, wideStore[i].startingLine);
+				Assert::AreEqual(shadowPromisesTokenizer.tokens[i].startingCharacter, wideStore[i].startingCharacter);
+			}
+
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(LazyPositionsResolveLikeTokenize)
+		{
+			Logger::WriteMessage("In LazyPositionsResolveLikeTokenize");
+
+			boost::filesystem::path testPath("TestCode.sp");
+			Tokenizer lazyTokenizer(ShadowPromisesGrammar::newTokenReadingMap(), shadowPromisesIdToTokenType);
+			lazyTokenizer.lazyPositions = true;
+			lazyTokenizer.tokenize(testPath);
+
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(testPath);
+
+			Assert::AreEqual(shadowPromisesTokenizer.tokens.size(), lazyTokenizer.tokens.size());
+			Assert::AreEqual(0L, lazyTokenizer.tokens[1].startingLine);
+
+			Token lastToken = lazyTokenizer.tokens.back();
+			Assert::IsTrue(lazyTokenizer.resolvePosition(lastToken));
+			Assert::AreEqual(shadowPromisesTokenizer.tokens.back().startingLine, lastToken.startingLine);
+			Assert::AreEqual(shadowPromisesTokenizer.tokens.back().startingCharacter, lastToken.startingCharacter);
+
+			lazyTokenizer.resolvePositions(lazyTokenizer.tokens);
+			for (size_t i = 0; i < lazyTokenizer.tokens.size(); i++)
+			{
+				Assert::AreEqual(shadowPromisesTokenizer.tokens[i].tokenString, lazyTokenizer.tokens[i].tokenString);
+				Assert::AreEqual(shadowPromisesTokenizer.tokens[i].startingLine, lazyTokenizer.tokens[i].startingLine);
+				Assert::AreEqual(shadowPromisesTokenizer.tokens[i].startingCharacter, lazyTokenizer.tokens[i].startingCharacter);
+			}
+
+			lazyTokenizer.cleanup();
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(TokenCursorMatchesTokenize)
+		{
+			Logger::WriteMessage("In TokenCursorMatchesTokenize");
+
+			boost::filesystem::path testPath("TestCode.sp");
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(testPath);
+			token_vector& tokens = shadowPromisesTokenizer.tokens;
+
+			TokenCursor cursor(shadowPromisesTokenizer, testPath, 2);
+			size_t i = 0;
+			do
+			{
+				Token lookahead = cursor.peek(3);
+				Token& expectedLookahead = tokens[min(i + 3, tokens.size() - 1)];
+				Assert::AreEqual(expectedLookahead.tokenString, lookahead.tokenString);
+
+				Token& token = cursor.current();
+				Assert::IsTrue(i < tokens.size());
+				Assert::AreEqual(tokens[i].tokenString, token.tokenString);
+				Assert::AreEqual(tokens[i].typeFlags, token.typeFlags);
+				Assert::AreEqual(tokens[i].startingLine, token.startingLine);
+				Assert::AreEqual(tokens[i].startingCharacter, token.startingCharacter);
+				i++;
+			} while (cursor.next());
+
+			Assert::AreEqual(tokens.size(), i);
+			Assert::IsTrue(cursor.atEnd());
+			Assert::IsFalse(cursor.next());
+
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(RetokenizeMatchesTokenize)
+		{
+			Logger::WriteMessage("In RetokenizeMatchesTokenize");
+
+			string source;
+			Tokenizer fullTokenizer(ShadowPromisesGrammar::newTokenReadingMap(), shadowPromisesIdToTokenType);
+
+			// Plain, then with validateUtf8 and codePointColumns
+			for (int options = 0; options < 4; options++)
+			{
+				shadowPromisesTokenizer.validateUtf8 = fullTokenizer.validateUtf8 = 0 != (options & 1);
+				shadowPromisesTokenizer.codePointColumns = fullTokenizer.codePointColumns = 0 != (options & 2);
+
+				source = "first {\n\t\"a string\" -2.5 ident\n}\n* comment *\nlast -123 4.5\n";
+				shadowPromisesTokenizer.cleanup();
+				shadowPromisesTokenizer.tokenize(string_view(source));
+				token_vector tokens = shadowPromisesTokenizer.tokens;
+
+				auto checkEdit = [&](const TokenEdit& edit) {
+					string edited = source.substr(0, edit.offset) + string(edit.insertedText) + source.substr(edit.offset + edit.removedLength);
+
+					auto changed = shadowPromisesTokenizer.retokenize(tokens, source, edited, edit);
+					source.swap(edited);
+
+					fullTokenizer.cleanup();
+					fullTokenizer.tokenize(string_view(source));
+
+					Assert::IsTrue(changed.first <= changed.second);
+					Assert::AreEqual(fullTokenizer.tokens.size(), tokens.size());
+					for (size_t i = 0; i < tokens.size(); i++)
+					{
+						Assert::AreEqual(fullTokenizer.tokens[i].tokenString, tokens[i].tokenString);
+						Assert::IsTrue(fullTokenizer.tokens[i].tokenString.data() == tokens[i].tokenString.data());
+						Assert::AreEqual(fullTokenizer.tokens[i].typeFlags, tokens[i].typeFlags);
+						Assert::AreEqual(fullTokenizer.tokens[i].startingLine, tokens[i].startingLine);
+						Assert::AreEqual(fullTokenizer.tokens[i].startingCharacter, tokens[i].startingCharacter);
+					}
+				};
+
+				// Extend a token, open a string that swallows lines, close it again, break a number, join two lines.
+				TokenEdit edits[] = {
+					{ 2, 0, "rst_fi"sv },
+					{ 10, 0, "\"\n"sv },
+					{ 10, 2, ""sv },
+					{ 36, 1, "X"sv },
+					{ 6, 3, ""sv },
+				};
+				for (auto& edit : edits) checkEdit(edit);
+
+				// Non-ASCII text before the tokens of a line, an edit after it on the line, a bad byte in a comment,
+				// and non-ASCII text before everything.
+				checkEdit({ source.find("last"), 0, "\xE2\x96\xB2 "sv });
+				checkEdit({ source.find("4.5"), 0, "7 "sv });
+				checkEdit({ source.find("comment"), 0, "\xFF"sv });
+				checkEdit({ 0, 0, "\xC3\xA9\xC3\xA9 "sv });
+			}
+			shadowPromisesTokenizer.validateUtf8 = fullTokenizer.validateUtf8 = false;
+			shadowPromisesTokenizer.codePointColumns = fullTokenizer.codePointColumns = false;
+
+			// The numbers of the Tokenizer's own tokens follow the edits
+			NumericValues numbers;
+			NumericValues fullNumbers;
+			shadowPromisesTokenizer.numericValues = &numbers;
+			fullTokenizer.numericValues = &fullNumbers;
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(string_view(source));
+
+			TokenEdit numberEdits[] = {
+				{ 0, 0, "7 "sv },
+				{ 12, 0, " 0x10 "sv },
+				{ 5, 3, ""sv },
+			};
+			for (auto& edit : numberEdits)
+			{
+				string edited = source.substr(0, edit.offset) + string(edit.insertedText) + source.substr(edit.offset + edit.removedLength);
+
+				shadowPromisesTokenizer.retokenize(shadowPromisesTokenizer.tokens, source, edited, edit);
+				source.swap(edited);
+
+				fullTokenizer.cleanup();
+				fullTokenizer.tokenize(string_view(source));
+
+				Assert::IsFalse(numbers.empty());
+				Assert::AreEqual(fullNumbers.size(), numbers.size());
+				for (size_t i = 0; i < numbers.size(); i++)
+				{
+					Assert::AreEqual(fullNumbers[i].tokenIndex, numbers[i].tokenIndex);
+					Assert::AreEqual(fullNumbers[i].integerValue, numbers[i].integerValue);
+				}
+			}
+
+			shadowPromisesTokenizer.numericValues = NULL;
+			fullTokenizer.numericValues = NULL;
+			fullTokenizer.cleanup();
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(TokenizeAllKeepsInputOrder)
+		{
+			Logger::WriteMessage("In TokenizeAllKeepsInputOrder");
+
+			boost::filesystem::path testPath("TestCode.sp");
+			Tokenizer sequentialTokenizer(ShadowPromisesGrammar::newTokenReadingMap(), shadowPromisesIdToTokenType);
+			sequentialTokenizer.tokenize(testPath);
+
+			vector<boost::filesystem::path> filePaths = { testPath, boost::filesystem::path("NoSuchFile.sp"), testPath };
+
+			WorkerPool pool(2);
+			shadowPromisesTokenizer.cleanup();
+			vector<TokenizedFile> results = shadowPromisesTokenizer.tokenizeAll(filePaths, 0, &pool);
+
+			Assert::AreEqual((size_t)3, results.size());
+			Assert::IsTrue(shadowPromisesTokenizer.tokens.empty());
+
+			Assert::IsFalse(results[1].error.empty());
+			Assert::IsTrue(results[1].tokens.empty());
+
+			for (size_t file : { 0, 2 })
+			{
+				TokenizedFile& result = results[file];
+				Assert::IsTrue(result.error.empty());
+				Assert::IsTrue(filePaths[file] == result.filePath);
+
+				Assert::AreEqual(sequentialTokenizer.tokens.size(), result.tokens.size());
+				for (size_t i = 0; i < sequentialTokenizer.tokens.size(); i++)
+				{
+					Assert::AreEqual(sequentialTokenizer.tokens[i].tokenString, result.tokens[i].tokenString);
+					Assert::AreEqual(sequentialTokenizer.tokens[i].typeFlags, result.tokens[i].typeFlags);
+					Assert::AreEqual(sequentialTokenizer.tokens[i].startingLine, result.tokens[i].startingLine);
+					Assert::AreEqual(sequentialTokenizer.tokens[i].startingCharacter, result.tokens[i].startingCharacter);
+				}
+			}
+
+			sequentialTokenizer.cleanup();
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(InternedIdentifiersShareAtoms)
+		{
+			Logger::WriteMessage("In InternedIdentifiersShareAtoms");
+
+			string source("s:Random + var1 @ var1\n\"var1\" + 12 @ var2\n");
+			AtomTable atoms;
+
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.atoms = &atoms;
+			shadowPromisesTokenizer.tokenize(string_view(source));
+
+			map<string_view, uint32_t> seen;
+			for (auto& token : shadowPromisesTokenizer.tokens)
+			{
+				if (Token::identifier == (token.typeFlags & ~Token::packageName))
+				{
+					Assert::AreNotEqual(AtomTable::noAtom, token.atom);
+					Assert::AreEqual(token.tokenString, atoms.text(token.atom));
+
+					auto found = seen.emplace(token.tokenString, token.atom).first;
+					Assert::AreEqual(found->second, token.atom);
+				}
+				else
+				{
+					Assert::AreEqual(AtomTable::noAtom, token.atom);
+				}
+			}
+
+			// var1, s:Random and var2 - the string "var1" is not interned
+			Assert::AreEqual((size_t)3, atoms.size());
+			Assert::AreNotEqual(AtomTable::noAtom, atoms.find("s:Random"));
+			Assert::AreEqual(AtomTable::noAtom, atoms.find("\"var1\""));
+
+			// Another tokenize gets the same atoms
+			Tokenizer otherTokenizer(ShadowPromisesGrammar::newTokenReadingMap(), shadowPromisesIdToTokenType);
+			otherTokenizer.atoms = &atoms;
+			otherTokenizer.tokenizeParallel(string_view(source), 2);
+
+			Assert::AreEqual(shadowPromisesTokenizer.tokens.size(), otherTokenizer.tokens.size());
+			for (size_t i = 0; i < otherTokenizer.tokens.size(); i++)
+			{
+				Assert::AreEqual(shadowPromisesTokenizer.tokens[i].atom, otherTokenizer.tokens[i].atom);
+			}
+			Assert::AreEqual((size_t)3, atoms.size());
+
+			// Every atom up to size() has its text, even while other threads are interning.
+			AtomTable shared;
+			atomic<bool> interning(true);
+			atomic<bool> missingText(false);
+			vector<thread> interners;
+			for (int t = 0; t < 4; t++)
+			{
+				interners.emplace_back([&shared, t]() {
+					for (int i = 0; i < 20000; i++) shared.intern("atom" + to_string(t) + "_" + to_string(i));
+				});
+			}
+			thread reader([&shared, &interning, &missingText]() {
+				while (interning.load())
+				{
+					size_t published = shared.size();
+					for (uint32_t atom = 1; atom <= published; atom++)
+					{
+						if (shared.text(atom).empty()) missingText = true;
+					}
+				}
+			});
+			for (auto& interner : interners) interner.join();
+			interning = false;
+			reader.join();
+			Assert::IsFalse(missingText.load());
+			Assert::AreEqual((size_t)80000, shared.size());
+
+			otherTokenizer.cleanup();
+			shadowPromisesTokenizer.atoms = NULL;
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(KeywordsHaveTheirTokenTypes)
+		{
+			Logger::WriteMessage("In KeywordsHaveTheirTokenTypes");
+
+			struct ExpectedKeyword
+			{
+				string_view	text;
+				long		typeFlags;
+				uint16_t	keywordId;
+			};
+			ExpectedKeyword expected[] = {
+				{ ":if", Token::keyword, keywordIf }, { ":then", Token::keyword, keywordThen }, { ":else", Token::keyword, keywordElse },
+				{ ":loop", Token::keyword, keywordLoop }, { ":loopExit", Token::keyword, keywordLoopExit }, { ":next", Token::keyword, keywordNext },
+				{ ":break", Token::keyword, keywordBreak }, { ":exit", Token::keyword, keywordExit }, { ":test", Token::keyword, keywordTest },
+				{ ":return", Token::functionReturn, keywordReturn }, { ":self", Token::selfCall, keywordSelf },
+				{ ":and", Token::keyword, keywordAnd }, { ":or", Token::keyword, keywordOr }, { ":nand", Token::keyword, keywordNand },
+				{ ":not", Token::keyword, keywordNot }, { ":function", Token::keyword, keywordFunction },
+				{ ":funcSpec", Token::keyword, keywordFuncSpec }, { ":scratch", Token::keyword, keywordScratch },
+				{ ":import", Token::keyword, keywordImport }, { ":startAsync", Token::keyword, keywordStartAsync },
+				{ ":continueWith", Token::keyword, keywordContinueWith }, { ":continueIf", Token::keyword, keywordContinueIf },
+				{ ":inline", Token::keyword, keywordInline }, { ":async", Token::keyword, keywordAsync },
+				{ ":thread", Token::keyword, keywordThread }, { ":remote", Token::keyword, keywordRemote },
+				{ ":uiThread", Token::keyword, keywordUiThread },
+				{ ":option", Token::compilerFlag, keywordOption }, { ":opt", Token::compilerFlag, keywordOpt },
+				{ ":define", Token::compilerFlag, keywordDefine }, { ":undefine", Token::compilerFlag, keywordUndefine },
+			};
+			size_t keywordCount = sizeof(expected) / sizeof(expected[0]);
+
+			string source;
+			for (auto& keyword : expected) source += string(keyword.text) + "\n";
+			source += ":iff :i :selfish :nan s:if :equals :";
+			size_t tokenCount = keywordCount + 7;
+
+			// Every keyword has an id of its own
+			set<uint16_t> ids;
+			for (auto& keyword : expected) ids.insert(keyword.keywordId);
+			Assert::AreEqual(keywordCount, ids.size());
+
+			// The static grammar, and the tokenReadingMap with shadowPromisesIdToTokenType
+			Tokenizer runtimeTokenizer(ShadowPromisesGrammar::newTokenReadingMap(), shadowPromisesIdToTokenType);
+			shadowPromisesTokenizer.cleanup();
+			for (Tokenizer* tokenizer : { &shadowPromisesTokenizer, &runtimeTokenizer })
+			{
+				tokenizer->tokenize(string_view(source));
+
+				Assert::AreEqual(tokenCount + 1, tokenizer->tokens.size());
+				for (size_t i = 0; i < tokenCount; i++)
+				{
+					const Token& token = tokenizer->tokens[i];
+					long typeFlags = (i < keywordCount) ? expected[i].typeFlags : (long)(Token::identifier | Token::packageName);
+					Assert::AreEqual(typeFlags, token.typeFlags);
+					Assert::AreEqual((i < keywordCount) ? expected[i].keywordId : (uint16_t)notAKeyword, token.keywordId);
+				}
+			}
+
+			// The compact store keeps the ids
+			CompactTokenStore compact(source, shadowPromisesTokenizer.tokens);
+			Assert::AreEqual((uint16_t)keywordContinueIf, compact[21].keywordId);
+			Assert::AreEqual((uint16_t)notAKeyword, compact[keywordCount].keywordId);
+
+			runtimeTokenizer.cleanup();
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(TokenArenaReusesItsBlocks)
+		{
+			Logger::WriteMessage("In TokenArenaReusesItsBlocks");
+
+			struct Counted
+			{
+				int& count;
+				Counted(int& inCount) : count(inCount) { count++; }
+				~Counted() { count--; }
+			};
+
+			TokenArena arena(1024);
+			int liveCount = 0;
+
+			for (int pass = 0; pass < 3; pass++)
+			{
+				for (int i = 0; i < 100; i++)
+				{
+					Assert::IsNotNull(arena.create<Counted>(liveCount));
+
+					double* aligned = arena.create<double>(1.0 * i);
+					Assert::AreEqual((size_t)0, (size_t)aligned % alignof(double));
+				}
+
+				// A bigger allocation than a block gets a block of its own
+				Assert::IsNotNull(arena.allocate(4096));
+				Assert::AreEqual(100, liveCount);
+
+				size_t reserved = arena.bytesReserved();
+				arena.reset();
+				Assert::AreEqual(0, liveCount);
+
+				// The same allocations again fit in the kept blocks
+				if (0 < pass) Assert::AreEqual(reserved, arena.bytesReserved());
+			}
+
+			// cleanup keeps the memory for the next tokenize
+			string source("s:Random + var1 @ var1\n\"var1\" + 12 @ var2\n");
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(string_view(source));
+			size_t tokenCount = shadowPromisesTokenizer.tokens.size();
+			size_t tokenCapacity = shadowPromisesTokenizer.tokens.capacity();
+
+			shadowPromisesTokenizer.cleanup();
+			Assert::IsTrue(shadowPromisesTokenizer.tokens.empty());
+			Assert::AreEqual(tokenCapacity, shadowPromisesTokenizer.tokens.capacity());
+
+			shadowPromisesTokenizer.tokenize(string_view(source));
+			Assert::AreEqual(tokenCount, shadowPromisesTokenizer.tokens.size());
+			Assert::AreEqual(tokenCapacity, shadowPromisesTokenizer.tokens.capacity());
+
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(TokenizerPoolReusesSessions)
+		{
+			Logger::WriteMessage("In TokenizerPoolReusesSessions");
+
+			string source("s:Random + var1 @ var1\n\"var1\" + 12 @ var2\n");
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(string_view(source));
+
+			TokenizerPool tokenizers([] { return &initShadowPromisesTokenizer(); }, 1);
+			Assert::AreEqual((size_t)1, tokenizers.size());
+
+			Tokenizer* firstTokenizer = NULL;
+			size_t tokenCapacity = 0;
+			for (int request = 0; request < 3; request++)
+			{
+				TokenizerPool::Session session = tokenizers.checkOut();
+				Assert::IsTrue(session->tokens.empty());
+
+				// The same Tokenizer comes back, with the capacity it had
+				if (0 == request) firstTokenizer = &*session;
+				Assert::IsTrue(firstTokenizer == &*session);
+				if (0 < request) Assert::AreEqual(tokenCapacity, session->tokens.capacity());
+
+				// A stream read too, so the ReadFileData has a buffer to keep
+				istringstream input(source);
+				session->tokenize(string_view(source));
+				session->tokenize(input);
+
+				Assert::AreEqual(2 * shadowPromisesTokenizer.tokens.size(), session->tokens.size());
+				for (size_t i = 0; i < session->tokens.size(); i++)
+				{
+					Token& expected = shadowPromisesTokenizer.tokens[i % shadowPromisesTokenizer.tokens.size()];
+					Assert::AreEqual(expected.tokenString, session->tokens[i].tokenString);
+					Assert::AreEqual(expected.typeFlags, session->tokens[i].typeFlags);
+				}
+
+				tokenCapacity = session->tokens.capacity();
+			}
+
+			// Sessions checked out at the same time get their own Tokenizers
+			{
+				TokenizerPool::Session first = tokenizers.checkOut();
+				TokenizerPool::Session second = tokenizers.checkOut();
+				Assert::IsTrue(&*first != &*second);
+				Assert::AreEqual((size_t)2, tokenizers.size());
+			}
+
+			// A ReadFileData using a string keeps its read buffer for the next read
+			ReadFileData fileData;
+			istringstream firstInput(source);
+			const char* readBuffer = fileData.readInFile(firstInput);
+			fileData.useExistingBuffer(source.data(), source.size());
+			fileData.release();
+			istringstream secondInput(source);
+			Assert::IsTrue(readBuffer == fileData.readInFile(secondInput));
+
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(TokenizersShareOneGrammar)
+		{
+			Logger::WriteMessage("In TokenizersShareOneGrammar");
+
+			boost::filesystem::path testPath("TestCode.sp");
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(testPath);
+
+			// initShadowPromisesTokenizer does not build a new grammar each time
+			Tokenizer& otherTokenizer = initShadowPromisesTokenizer();
+			Assert::IsTrue(shadowPromisesTokenizer.getGrammar() == otherTokenizer.getGrammar());
+			delete &otherTokenizer;
+
+			// A Tokenizer for each thread, all scanning with the same grammar at once
+			const int threadCount = 4;
+			vector<unique_ptr<Tokenizer>> tokenizers;
+			for (int i = 0; i < threadCount; i++) tokenizers.emplace_back(new Tokenizer(shadowPromisesTokenizerGrammar()));
+
+			vector<thread> threads;
+			for (int i = 0; i < threadCount; i++)
+			{
+				threads.emplace_back([&testPath, &tokenizers, i]() {
+					for (int pass = 0; pass < 20; pass++)
+					{
+						tokenizers[i]->reset();
+						tokenizers[i]->tokenize(testPath);
+					}
+				});
+			}
+			for (auto& worker : threads) worker.join();
+
+			for (auto& tokenizer : tokenizers)
+			{
+				Assert::AreEqual(shadowPromisesTokenizer.tokens.size(), tokenizer->tokens.size());
+				for (size_t i = 0; i < tokenizer->tokens.size(); i++)
+				{
+					Assert::AreEqual(shadowPromisesTokenizer.tokens[i].tokenString, tokenizer->tokens[i].tokenString);
+					Assert::AreEqual(shadowPromisesTokenizer.tokens[i].typeFlags, tokenizer->tokens[i].typeFlags);
+					Assert::AreEqual(shadowPromisesTokenizer.tokens[i].startingLine, tokenizer->tokens[i].startingLine);
+					Assert::AreEqual(shadowPromisesTokenizer.tokens[i].startingCharacter, tokenizer->tokens[i].startingCharacter);
+				}
+			}
+
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(TokenizerStatsCountTheScan)
+		{
+			Logger::WriteMessage("In TokenizerStatsCountTheScan");
+
+			Tokenizer& tokenizer = initShadowPromisesTokenizer();
+			tokenizer.tokenize("12 @ count\n~ 0x1F @ mask\n"sv);
+
+			TokenizerStats stats = tokenizer.getStatistics();
+			if (!TokenizerStats::enabled)
+			{
+				// Built without TOKENIZER_STATS - nothing is counted
+				Assert::AreEqual((uint64_t)0, stats.tokenCount());
+				delete &tokenizer;
+				return;
+			}
+
+			// Every token but the endOfInput
+			Assert::AreEqual((uint64_t)1, stats.scans);
+			Assert::AreEqual((uint64_t)(tokenizer.tokens.size() - 1), stats.tokenCount());
+			Assert::AreEqual((uint64_t)2, stats.tokenTypes[Token::assignment]);
+			Assert::AreEqual((uint64_t)1, stats.failureCount(Token::badPunctuation));
+			Assert::AreEqual((uint64_t)1, stats.failureCount());
+
+			// count and mask
+			Assert::AreEqual((uint64_t)2, stats.matchers['a'].calls);
+			Assert::AreEqual((uint64_t)9, stats.matchers['a'].bytes);
+
+			// Kept by reset, so a pooled Tokenizer counts all its requests
+			tokenizer.reset();
+			tokenizer.tokenize("12 @ count\n"sv);
+			Assert::AreEqual((uint64_t)2, tokenizer.getStatistics().scans);
+			Assert::AreEqual((uint64_t)3, tokenizer.getStatistics().tokenTypes[Token::assignment]);
+
+			tokenizer.clearStatistics();
+			Assert::AreEqual((uint64_t)0, tokenizer.getStatistics().tokenCount());
+
+			delete &tokenizer;
+		}
+
+		TEST_METHOD(TokenDumperWritesEachFormat)
+		{
+			Logger::WriteMessage("In TokenDumperWritesEachFormat");
+
+			Tokenizer& tokenizer = initShadowPromisesTokenizer();
+			tokenizer.tokenize("s:print @ out\n\"tab\there\"\n"sv);
+
+			ostringstream human;
+			{
+				TokenDumper dumper(human);
+				dumper.dump(tokenizer.tokens);
+				dumper.finish();
+			}
+			Assert::IsTrue(0 == human.str().find("TokenIndex:  0  String: s:print\nLine: 1  Characer: 1\nType: identifier packageName\n\n"));
+
+			ostringstream json;
+			{
+				TokenDumper dumper(json, TokenDumpFormat::jsonLines);
+				dumper.setTokenIndex(10);
+				dumper.dump(tokenizer.tokens);
+				dumper.finish();
+			}
+			string jsonText = json.str();
+			Assert::IsTrue(0 == jsonText.find("{\"index\":10,\"type\":\"identifier packageName\",\"line\":1,\"character\":1,\"text\":\"s:print\"}\n"));
+			Assert::IsTrue(string::npos != jsonText.find("\"text\":\"\\\"tab\\there\\\"\"}"));
+
+			// Good utf8 as it is, a bad byte as U+FFFD - the line stays good JSON
+			tokenizer.cleanup();
+			tokenizer.tokenize("caf\xC3\xA9 b\xFF" "d\n"sv);
+			ostringstream utf8Json;
+			{
+				TokenDumper dumper(utf8Json, TokenDumpFormat::jsonLines);
+				dumper.dump(tokenizer.tokens);
+				dumper.finish();
+			}
+			Assert::IsTrue(string::npos != utf8Json.str().find("\"text\":\"caf\xC3\xA9\"}"));
+			Assert::IsTrue(string::npos != utf8Json.str().find("\"text\":\"b\\ufffdd\"}"));
+			tokenizer.cleanup();
+			tokenizer.tokenize("s:print @ out\n\"tab\there\"\n"sv);
+
+			ostringstream binary;
+			{
+				TokenDumper dumper(binary, TokenDumpFormat::binary);
+				dumper.dump(tokenizer.tokens);
+				dumper.finish();
+			}
+			string binaryText = binary.str();
+			size_t textBytes = 0;
+			for (auto& token : tokenizer.tokens) textBytes += token.tokenString.size();
+			Assert::AreEqual(sizeof(TokenDumpHeader) + tokenizer.tokens.size() * sizeof(TokenDumpRecord) + textBytes, binaryText.size());
+
+			TokenDumpRecord first;
+			memcpy(&first, binaryText.data() + sizeof(TokenDumpHeader), sizeof(first));
+			Assert::AreEqual((int32_t)(Token::identifier | Token::packageName), first.typeFlags);
+			Assert::AreEqual((uint32_t)7, first.length);
+
+			ostringstream summary;
+			{
+				TokenDumper dumper(summary, TokenDumpFormat::summary);
+				dumper.dump(tokenizer.tokens);
+				dumper.finish();
+			}
+			Assert::IsTrue(0 == summary.str().find("Tokens: 5  Bytes: 21\n"));
+
+			delete &tokenizer;
+		}
+
+		TEST_METHOD(TokenCacheSkipsUnchangedFiles)
+		{
+			Logger::WriteMessage("In TokenCacheSkipsUnchangedFiles");
+
+			boost::filesystem::path cacheDirectory = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("tokens-%%%%%%%%");
+			boost::filesystem::path testPath("TestCode.sp");
+
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(testPath);
+
+			{
+				TokenCache cache(cacheDirectory);
+				Tokenizer& tokenizer = initShadowPromisesTokenizer();
+				tokenizer.tokenCache = &cache;
+
+				// Scanned and saved, then loaded
+				for (int pass = 0; pass < 2; pass++)
+				{
+					tokenizer.reset();
+					tokenizer.tokenize(testPath);
+
+					Assert::AreEqual(shadowPromisesTokenizer.tokens.size(), tokenizer.tokens.size());
+					for (size_t i = 0; i < tokenizer.tokens.size(); i++)
+					{
+						Assert::AreEqual(shadowPromisesTokenizer.tokens[i].tokenString, tokenizer.tokens[i].tokenString);
+						Assert::AreEqual(shadowPromisesTokenizer.tokens[i].typeFlags, tokenizer.tokens[i].typeFlags);
+						Assert::AreEqual(shadowPromisesTokenizer.tokens[i].keywordId, tokenizer.tokens[i].keywordId);
+						Assert::AreEqual(shadowPromisesTokenizer.tokens[i].startingLine, tokenizer.tokens[i].startingLine);
+						Assert::AreEqual(shadowPromisesTokenizer.tokens[i].startingCharacter, tokenizer.tokens[i].startingCharacter);
+					}
+				}
+
+				// The saved file is read in place
+				string_view source = "12 @ count\n"sv;
+				Assert::IsFalse(cache.load(source, tokenizer.tokens));
+				tokenizer.reset();
+				tokenizer.tokenize(source);
+				Assert::IsTrue(cache.store(source, tokenizer.tokens));
+
+				uint64_t hash = TokenCache::hashSource(source);
+				uint64_t checkHash = TokenCache::hashSource(source, TokenCache::checkSeed);
+				TokenCacheFile cacheFile;
+				Assert::IsTrue(cacheFile.open(cache.pathFor(hash), source, hash, checkHash, 0));
+				Assert::AreEqual(tokenizer.tokens.size(), cacheFile.size());
+				Assert::AreEqual((uint32_t)3, cacheFile.record(1).offset);
+				Assert::AreEqual(string_view("count"), cacheFile.token(2, source).tokenString);
+
+				// Not for a different source of the same size, or a different grammar
+				token_vector notLoaded;
+				Assert::IsFalse(cache.load("13 @ count\n"sv, notLoaded));
+				Assert::IsFalse(cacheFile.open(cache.pathFor(hash), source, hash, checkHash, 1));
+				cacheFile.close();
+
+				// Not for a source whose contentHash collides - the checkHash has to match too
+				string_view colliding = "14 @ count\n"sv;
+				uint64_t collidingHash = TokenCache::hashSource(colliding);
+				string cacheBytes;
+				{
+					ifstream cacheInput(cache.pathFor(hash).string(), ios::binary);
+					cacheBytes.assign(istreambuf_iterator<char>(cacheInput), istreambuf_iterator<char>());
+				}
+				memcpy(cacheBytes.data() + offsetof(TokenCacheHeader, contentHash), &collidingHash, sizeof(collidingHash));
+				{
+					ofstream cacheOutput(cache.pathFor(collidingHash).string(), ios::binary);
+					cacheOutput.write(cacheBytes.data(), cacheBytes.size());
+				}
+				Assert::IsFalse(cache.load(colliding, notLoaded));
+
+				// Saved without positions - only for a lazyPositions Tokenizer
+				tokenizer.reset();
+				tokenizer.lazyPositions = true;
+				tokenizer.tokenize(source);
+				Assert::IsTrue(cache.store(source, tokenizer.tokens, 0, false));
+
+				token_vector loaded;
+				Assert::IsFalse(cache.load(source, loaded));
+				Assert::IsTrue(cache.load(source, loaded, false));
+				Assert::AreEqual(tokenizer.tokens.size(), loaded.size());
+
+				delete &tokenizer;
+			}
+
+			boost::filesystem::remove_all(cacheDirectory);
+		}
+
+		TEST_METHOD(FileIngestorReadsEveryFile)
+		{
+			Logger::WriteMessage("In FileIngestorReadsEveryFile");
+
+			boost::filesystem::path directory = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("ingest-%%%%%%%%");
+			boost::filesystem::create_directories(directory);
+
+			// Small files that are read, a large one that is mapped, an empty one and one that is missing
+			vector<boost::filesystem::path> filePaths;
+			vector<string> contents;
+			for (int i = 0; i < 40; i++)
+			{
+				string text;
+				if (i == 7) text = string(ReadFileData::mapThreshold + 100, 'm');
+				else if (i != 9) text = "file " + to_string(i) + "\n" + string(i * 97, 'a' + i % 26);
+
+				filePaths.push_back(directory / ("file" + to_string(i) + ".sp"));
+				contents.push_back(text);
+				ofstream(filePaths.back().string(), ios::binary) << text;
+			}
+			filePaths.push_back(directory / "NoSuchFile.sp");
+
+			for (unsigned queueDepth : { 64u, 3u })
+			{
+				vector<ReadFileData> fileData(filePaths.size());
+				vector<ReadFileData*> fileDataPointers;
+				for (auto& data : fileData) fileDataPointers.push_back(&data);
+
+				vector<atomic<int>> readyCalls(filePaths.size());
+				vector<string> errors(filePaths.size());
+
+				WorkerPool pool(2);
+				FileIngestor ingestor(&pool);
+				ingestor.queueDepth = queueDepth;
+				Assert::IsFalse(ingestor.usesIoUring());
+				ingestor.readAll(filePaths, fileDataPointers, [&readyCalls, &errors](size_t index, const string& error) {
+						readyCalls[index]++;
+						errors[index] = error;
+					});
+
+				for (size_t i = 0; i < contents.size(); i++)
+				{
+					Assert::AreEqual(1, readyCalls[i].load());
+					Assert::IsTrue(errors[i].empty());
+					Assert::AreEqual(contents[i], string(fileData[i].start(), fileData[i].end()));
+				}
+
+				Assert::AreEqual(1, readyCalls.back().load());
+				Assert::IsFalse(errors.back().empty());
+			}
+
+			boost::filesystem::remove_all(directory);
+		}
+
+		TEST_METHOD(CApiFillsTokenColumns)
+		{
+			Logger::WriteMessage("In CApiFillsTokenColumns");
+
+			string source("s:Random + var1 @ var1\n\"var1\" + 12 @ var2\n/* a\ncomment */ :if { var2 }\n");
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(string_view(source));
+			token_vector& expected = shadowPromisesTokenizer.tokens;
+
+			Assert::AreEqual((uint32_t)SPT_ABI_VERSION, sptAbiVersion());
+			SptTokenizer* tokenizer = sptCreate();
+			Assert::IsNotNull(tokenizer);
+
+			// Into the caller's arrays, a few at a time
+			Assert::AreEqual(SPT_OK, sptBegin(tokenizer, source.data(), source.size(), 0));
+
+			uint32_t offsets[3], lengths[3];
+			int32_t types[3], lines[3], characters[3];
+			SptTokenColumns columns = { offsets, lengths, types, lines, characters, 3 };
+
+			size_t index = 0;
+			size_t count;
+			while (0 < (count = sptNextBatch(tokenizer, &columns)))
+			{
+				for (size_t i = 0; i < count; i++, index++)
+				{
+					Assert::IsTrue(index < expected.size());
+					Assert::IsTrue(source.data() + offsets[i] == expected[index].tokenString.data());
+					Assert::AreEqual(expected[index].tokenString.size(), (size_t)lengths[i]);
+					Assert::AreEqual(expected[index].typeFlags, (long)types[i]);
+					Assert::AreEqual(expected[index].startingLine, (long)lines[i]);
+					Assert::AreEqual(expected[index].startingCharacter, (long)characters[i]);
+				}
+			}
+			Assert::AreEqual(expected.size(), index);
+			Assert::AreEqual((int32_t)Token::endOfInput, types[(index - 1) % 3]);
+			Assert::AreEqual((uint32_t)source.size(), offsets[(index - 1) % 3]);
+
+			// All of them into the tokenizer's arrays, without the positions
+			Assert::AreEqual(SPT_OK, sptBegin(tokenizer, source.data(), source.size(), SPT_LAZY_POSITIONS));
+
+			SptTokenBatch batch;
+			Assert::AreEqual(expected.size(), sptNextOwnedBatch(tokenizer, 0, 0, &batch));
+			Assert::IsNull(batch.lines);
+			for (size_t i = 0; i < batch.count; i++)
+			{
+				Assert::AreEqual(expected[i].tokenString, string_view(source.data() + batch.offsets[i], batch.lengths[i]));
+				Assert::AreEqual(expected[i].typeFlags, (long)batch.types[i]);
+			}
+			Assert::AreEqual((size_t)0, sptNextOwnedBatch(tokenizer, 0, 0, &batch));
+
+			Assert::AreEqual(string("identifier"), string(sptTypeName(Token::identifier | Token::packageName)));
+			Assert::IsNull(sptTypeName(-5));
+
+			// No arrays is an error, not a crash
+			Assert::AreEqual((size_t)0, sptNextBatch(tokenizer, NULL));
+			Assert::AreNotEqual(string(), string(sptLastError(tokenizer)));
+
+			sptDestroy(tokenizer);
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(StringLiteralsDecodeEscapes)
+		{
+			Logger::WriteMessage("In StringLiteralsDecodeEscapes");
+
+			string source("\"plain\" 'a\\tb' 'test \xE2\x96\xB2\\u{25B2} \\x{0d}\\x{0a}' \"q\\\"q\" 'bad \\u{D800}'\n");
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(string_view(source));
+			token_vector& tokens = shadowPromisesTokenizer.tokens;
+
+			Assert::AreEqual((size_t)6, tokens.size());
+			for (size_t i = 0; i < 5; i++) Assert::AreEqual((long)Token::stringValue, tokens[i].typeFlags);
+			Assert::IsFalse(tokens[0].hasEscape);
+			Assert::IsTrue(tokens[1].hasEscape);
+
+			StringLiterals literals;
+
+			// No escape - the source itself
+			string_view text;
+			Assert::IsTrue(literals.value(tokens[0], text));
+			Assert::AreEqual("plain"sv, text);
+			Assert::IsTrue(source.data() + 1 == text.data());
+
+			Assert::AreEqual("a\tb"sv, literals.value(tokens[1]));
+			Assert::AreEqual("test \xE2\x96\xB2\xE2\x96\xB2 \r\n"sv, literals.value(tokens[2]));
+			Assert::AreEqual("q\"q"sv, literals.value(tokens[3]));
+
+			// Decoded once
+			Assert::IsTrue(literals.value(tokens[1]).data() == literals.value(tokens[1]).data());
+
+			// A surrogate is kept as it is
+			Assert::IsFalse(literals.value(tokens[4], text));
+			Assert::AreEqual("bad \\u{D800}"sv, text);
+
+			Assert::AreEqual((size_t)(3 + 14 + 3 + 12), literals.copiedBytes());
+
+			// The flag survives the compact store
+			CompactTokenStore store(source, tokens);
+			Assert::IsFalse(store[0].hasEscape);
+			Assert::IsTrue(store[1].hasEscape);
+			Assert::AreEqual((long)Token::stringValue, store[1].typeFlags);
+
+			// A reused buffer - the Tokenizer clears the values, so another string at the same address is decoded again
+			shadowPromisesTokenizer.stringLiterals = &literals;
+			string reused("\"a\\tb\"\n");
+			shadowPromisesTokenizer.reset();
+			shadowPromisesTokenizer.tokenize(string_view(reused));
+			Assert::AreEqual(string_view("a\tb"), literals.value(tokens[0]));
+			reused[3] = 'n';
+			shadowPromisesTokenizer.reset();
+			shadowPromisesTokenizer.tokenize(string_view(reused));
+			Assert::AreEqual(string_view("a\nb"), literals.value(tokens[0]));
+			shadowPromisesTokenizer.stringLiterals = NULL;
+
+			literals.clear();
+			Assert::AreEqual((size_t)0, literals.copiedBytes());
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(NumericValuesParsedWithTheTokens)
+		{
+			Logger::WriteMessage("In NumericValuesParsedWithTheTokens");
+
+			string source("a @ 5.5e2 -.2e-1 0xABCD 42 -7\n99999999999999999999 1e999 -1e-999 0xFFFFFFFFFFFFFFFF 0x1FFFFFFFFFFFFFFFF\n");
+
+			NumericValues numbers;
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.numericValues = &numbers;
+			shadowPromisesTokenizer.tokenize(string_view(source));
+			token_vector& tokens = shadowPromisesTokenizer.tokens;
+
+			Assert::AreEqual((size_t)10, numbers.size());
+			Assert::IsNull(numbers.find(0));
+			Assert::IsNull(numbers.find(1));
+
+			const NumericValue* value = numbers.find(2);
+			Assert::IsNotNull(value);
+			Assert::AreEqual(5.5e2, value->floatingValue);
+			Assert::AreEqual(-.2e-1, numbers.find(3)->floatingValue);
+
+			value = numbers.find(4);
+			Assert::IsTrue(NumericValue::integer == value->kind);
+			Assert::AreEqual((int64_t)0xABCD, value->integerValue);
+			Assert::AreEqual((int64_t)42, numbers.find(5)->integerValue);
+			Assert::AreEqual((int64_t)-7, numbers.find(6)->integerValue);
+
+			// Out of range
+			value = numbers.find(7);
+			Assert::IsTrue(NumericValue::floating == value->kind && value->hasOverflow());
+			Assert::AreEqual(1e20, value->floatingValue);
+			Assert::IsTrue(numbers.find(8)->hasOverflow() && numeric_limits<double>::infinity() == numbers.find(8)->floatingValue);
+			Assert::IsTrue(numbers.find(9)->hasOverflow() && 0.0 == numbers.find(9)->floatingValue);
+			Assert::IsFalse(numbers.find(10)->hasOverflow());
+			Assert::AreEqual((int64_t)-1, numbers.find(10)->integerValue);
+			Assert::IsTrue(numbers.find(11)->hasOverflow());
+			Assert::AreEqual((int64_t)-1, numbers.find(11)->integerValue);
+
+			// The same table from a parallel tokenize of the test code
+			boost::filesystem::path testPath("TestCode.sp");
+			shadowPromisesTokenizer.cleanup();
+			Assert::IsTrue(numbers.empty());
+			shadowPromisesTokenizer.tokenize(testPath);
+			vector<NumericValue> sequential(numbers.begin(), numbers.end());
+			Assert::IsFalse(sequential.empty());
+
+			WorkerPool pool(3);
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.parallelChunkSize = 64;
+			shadowPromisesTokenizer.tokenizeParallel(testPath, 0, &pool);
+			shadowPromisesTokenizer.parallelChunkSize = 1024 * 1024;
+
+			Assert::AreEqual(sequential.size(), numbers.size());
+			for (size_t i = 0; i < sequential.size(); i++)
+			{
+				Assert::AreEqual(sequential[i].tokenIndex, numbers[i].tokenIndex);
+				Assert::AreEqual(sequential[i].integerValue, numbers[i].integerValue);
+				Assert::IsTrue(Token::number == tokens[numbers[i].tokenIndex].typeFlags || Token::hexNumber == tokens[numbers[i].tokenIndex].typeFlags);
+			}
+
+			shadowPromisesTokenizer.numericValues = NULL;
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(Utf8CheckedAndColumnsInCharacters)
+		{
+			Logger::WriteMessage("In Utf8CheckedAndColumnsInCharacters");
+
+			// A long ASCII line first, so skipAscii takes full vector steps before the first non-ASCII byte
+			string source("// " + string(100, 'x') + "\n");
+			source += "\u00e9 @ 1\n";
+			source += "name\u00e9x @ '\u00fc\u4e2d' @ z\n";
+			source += "bad\xC0\xAF @ q\n";
+			source += "\xF0\x9F\x98\x80 @ 2\n";
+
+			auto startingLevel = scanKernels->level;
+			for (auto level : { ScanningKernels::scalar, ScanningKernels::best })
+			{
+				selectScanningKernels(level);
+
+				ReadFileData data;
+				data.useExistingBuffer(source.data(), source.size());
+				data.checkUtf8();
+				Assert::AreEqual((size_t)2, data.badUtf8().size());
+				Assert::AreEqual(source.find("\xC0"), data.badUtf8()[0]);
+				Assert::AreEqual((size_t)5, data.nonAscii().size());
+
+				shadowPromisesTokenizer.cleanup();
+				shadowPromisesTokenizer.validateUtf8 = true;
+				shadowPromisesTokenizer.codePointColumns = true;
+				shadowPromisesTokenizer.tokenize(string_view(source));
+				token_vector& tokens = shadowPromisesTokenizer.tokens;
+
+				// The character each token starts at, by line
+				vector<vector<long>> expected = { { 1 }, { 1, 3, 5 }, { 1, 8, 10, 15, 17 }, { 1, 7, 9 }, { 1, 3, 5 } };
+				size_t index = 0;
+				for (size_t line = 0; line < expected.size(); line++)
+				{
+					for (long character : expected[line])
+					{
+						Assert::AreEqual((long)line + 1, tokens[index].startingLine);
+						Assert::AreEqual(character, tokens[index].startingCharacter);
+						index++;
+					}
+				}
+
+				Assert::AreEqual((long)Token::badEncoding, tokens[9].typeFlags);
+				Assert::AreEqual((long)Token::identifier, tokens[4].typeFlags);
+				Assert::AreEqual((long)Token::stringValue, tokens[6].typeFlags);
+
+				// Resolved positions count the same way
+				Token resolved = tokens[7];
+				resolved.startingCharacter = 0;
+				Assert::IsTrue(shadowPromisesTokenizer.resolvePosition(resolved));
+				Assert::AreEqual((long)15, resolved.startingCharacter);
+			}
+
+			// Each tokenize checks its own source - not an earlier, shorter tokenize of the same buffer.
+			// The bad token is not interned, sequential or parallel.
+			string reused("a b\nc\xFF" "d \xC3\xA9\xC3\xA9 e\n");
+			AtomTable atoms;
+			shadowPromisesTokenizer.atoms = &atoms;
+			for (bool parallel : { false, true })
+			{
+				shadowPromisesTokenizer.cleanup();
+				shadowPromisesTokenizer.tokenize(string_view(reused.data(), 3));
+				size_t first = shadowPromisesTokenizer.tokens.size();
+
+				shadowPromisesTokenizer.parallelChunkSize = 4;
+				if (parallel) shadowPromisesTokenizer.tokenizeParallel(string_view(reused), 2);
+				else shadowPromisesTokenizer.tokenize(string_view(reused));
+				shadowPromisesTokenizer.parallelChunkSize = 1024 * 1024;
+
+				token_vector& tokens = shadowPromisesTokenizer.tokens;
+				Assert::AreEqual(first + 6, tokens.size());
+				Assert::AreEqual((long)Token::badEncoding, tokens[first + 2].typeFlags);
+				Assert::AreEqual(AtomTable::noAtom, tokens[first + 2].atom);
+				Assert::AreEqual(8L, tokens[first + 4].startingCharacter);
+			}
+			shadowPromisesTokenizer.atoms = NULL;
+
+			selectScanningKernels(startingLevel);
+			shadowPromisesTokenizer.validateUtf8 = false;
+			shadowPromisesTokenizer.codePointColumns = false;
+			shadowPromisesTokenizer.cleanup();
+		}
+
+		TEST_METHOD(TriviaKeptOutOfTheTokens)
+		{
+			Logger::WriteMessage("In TriviaKeptOutOfTheTokens");
+
+			string source("a @ 5 / note\n*multi\nline* b\n");
+
+			TokenTrivia trivia;
+			NumericValues numbers;
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.trivia = &trivia;
+			shadowPromisesTokenizer.numericValues = &numbers;
+			shadowPromisesTokenizer.tokenize(string_view(source));
+			token_vector& tokens = shadowPromisesTokenizer.tokens;
+
+			// a @ 5 b endOfInput - the comments are before b
+			Assert::AreEqual((size_t)5, tokens.size());
+			Assert::IsTrue(string_view("b") == tokens[3].tokenString);
+			Assert::AreEqual(3L, tokens[3].startingLine);
+			Assert::IsTrue(Token::endOfInput == tokens[4].typeFlags);
+			Assert::AreEqual((size_t)1, numbers.size());
+			Assert::AreEqual((int64_t)5, numbers.find(2)->integerValue);
+
+			Assert::AreEqual((size_t)2, trivia.size());
+			Assert::IsTrue(trivia.before(0).empty());
+			Assert::IsTrue(trivia.before(2).empty());
+			span<const TriviaEntry> comments = trivia.after(2);
+			Assert::AreEqual((size_t)2, comments.size());
+			Assert::IsTrue(string_view("/ note") == comments[0].token.tokenString);
+			Assert::IsTrue(Token::multiLineComment == comments[1].token.typeFlags);
+			Assert::AreEqual(2L, comments[1].token.startingLine);
+			Assert::AreEqual(1L, comments[1].token.startingCharacter);
+
+			// With the whitespace - the source is all there, in order
+			shadowPromisesTokenizer.cleanup();
+			Assert::IsTrue(trivia.empty());
+			trivia.keepWhitespace = true;
+			shadowPromisesTokenizer.tokenize(string_view(source));
+
+			Assert::AreEqual((size_t)5, tokens.size());
+			Assert::AreEqual((size_t)8, trivia.size());
+			Assert::AreEqual((size_t)5, trivia.before(3).size());
+			Assert::IsTrue(string_view("\n") == trivia.before(4)[0].token.tokenString);
+
+			string rebuilt;
+			for (size_t i = 0; i < tokens.size(); i++)
+			{
+				for (auto& entry : trivia.before(i)) rebuilt += entry.token.tokenString;
+				rebuilt += tokens[i].tokenString;
+			}
+			Assert::AreEqual(source, rebuilt);
+
+			Token newline = trivia.before(3)[2].token;
+			Assert::IsTrue(Token::whitespace == newline.typeFlags);
+			Assert::IsTrue(shadowPromisesTokenizer.resolvePosition(newline));
+			Assert::AreEqual(1L, newline.startingLine);
+			Assert::AreEqual(13L, newline.startingCharacter);
+
+			// The same from a parallel tokenize of the test code
+			boost::filesystem::path testPath("TestCode.sp");
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(testPath);
+			token_vector sequentialTokens = tokens;
+			vector<TriviaEntry> sequential(trivia.begin(), trivia.end());
+			Assert::IsFalse(sequential.empty());
+
+			WorkerPool pool(3);
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.parallelChunkSize = 64;
+			shadowPromisesTokenizer.tokenizeParallel(testPath, 0, &pool);
+			shadowPromisesTokenizer.parallelChunkSize = 1024 * 1024;
+
+			Assert::AreEqual(sequentialTokens.size(), tokens.size());
+			Assert::AreEqual(sequential.size(), trivia.size());
+			for (size_t i = 0; i < sequential.size(); i++)
+			{
+				Assert::AreEqual(sequential[i].tokenIndex, trivia[i].tokenIndex);
+				Assert::IsTrue(sequential[i].token.tokenString.size() == trivia[i].token.tokenString.size());
+			}
+			for (auto& token : tokens) Assert::IsFalse(TokenTrivia::isTrivia(token));
+
+			// Dropped - not kept anywhere
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.dropTrivia = true;
+			shadowPromisesTokenizer.tokenize(string_view(source));
+			shadowPromisesTokenizer.dropTrivia = false;
+
+			Assert::AreEqual((size_t)5, tokens.size());
+			Assert::IsTrue(trivia.empty());
+
+			// A retokenize keeps the trivia in step with the tokens
+			string edited(source);
+			edited.insert(0, "x ");		// Long enough not to be a short string, so the buffers stay put in the swaps
+			source.swap(edited);
+			shadowPromisesTokenizer.cleanup();
+			shadowPromisesTokenizer.tokenize(string_view(source));
+
+			TokenTrivia fullTrivia(true);
+			Tokenizer fullTokenizer(ShadowPromisesGrammar::newTokenReadingMap(), shadowPromisesIdToTokenType);
+			fullTokenizer.trivia = &fullTrivia;
+
+			// A comment at the start, a comment changed, a comment opened and closed, tokens after the comments
+			TokenEdit edits[] = {
+				{ 0, 0, "/ top\n"sv },
+				{ source.find("note") + 6, 2, "memo"sv },
+				{ source.find("b\n") + 6, 0, " c *d"sv },
+				{ source.find("b\n") + 11, 0, "*"sv },
+				{ 2, 0, "*"sv },
+			};
+			for (auto& edit : edits)
+			{
+				edited = source.substr(0, edit.offset) + string(edit.insertedText) + source.substr(edit.offset + edit.removedLength);
+
+				shadowPromisesTokenizer.retokenize(tokens, source, edited, edit);
+				source.swap(edited);
+
+				fullTokenizer.cleanup();
+				fullTokenizer.tokenize(string_view(source));
+
+				Assert::AreEqual(fullTokenizer.tokens.size(), tokens.size());
+				for (size_t i = 0; i < tokens.size(); i++)
+				{
+					Assert::IsTrue(fullTokenizer.tokens[i].tokenString == tokens[i].tokenString);
+					Assert::IsFalse(TokenTrivia::isTrivia(tokens[i]));
+				}
+
+				Assert::AreEqual(fullTrivia.size(), trivia.size());
+				for (size_t i = 0; i < trivia.size(); i++)
+				{
+					Assert::AreEqual(fullTrivia[i].tokenIndex, trivia[i].tokenIndex);
+					Assert::IsTrue(fullTrivia[i].token.tokenString == trivia[i].token.tokenString);
+					Assert::IsTrue(source.data() <= trivia[i].token.tokenString.data());
+					Assert::AreEqual(fullTrivia[i].token.typeFlags, trivia[i].token.typeFlags);
+					Assert::AreEqual(fullTrivia[i].token.startingLine, trivia[i].token.startingLine);
+					Assert::AreEqual(fullTrivia[i].token.startingCharacter, trivia[i].token.startingCharacter);
+				}
+			}
+
+			// Dropped by the retokenize too
+			TokenEdit comment = { 0, 0, "/ dropped\n"sv };
+			edited = source.substr(0, comment.offset) + string(comment.insertedText) + source.substr(comment.offset);
+			size_t tokenCount = tokens.size();
+			shadowPromisesTokenizer.dropTrivia = true;
+			shadowPromisesTokenizer.retokenize(tokens, source, edited, comment);
+			shadowPromisesTokenizer.dropTrivia = false;
+			source.swap(edited);
+			Assert::AreEqual(tokenCount, tokens.size());
+
+			fullTokenizer.cleanup();
+			shadowPromisesTokenizer.trivia = NULL;
+			shadowPromisesTokenizer.numericValues = NULL;
+			shadowPromisesTokenizer.cleanup();
+		}
+
 		TEST_METHOD(ParserMemoryMappedFile)
 		{
 			//shadowPromisesTokenizer.cleanup();